@@ -0,0 +1,161 @@
+#ifndef WAYLAND_EGL_EXT_H
+# define WAYLAND_EGL_EXT_H
+
+#include <stdint.h>
+#include <wayland-egl.h>
+
+struct wl_egl_buffer_cache_stats {
+	uint64_t size;		/* bytes held by unused buffers */
+	uint64_t max_size;	/* cache budget, in bytes */
+	uint32_t count;		/* number of unused buffers */
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+enum wl_egl_memory_backend {
+	WL_EGL_MEMORY_GDL,
+	WL_EGL_MEMORY_SHM,
+	WL_EGL_MEMORY_BACKENDS,
+};
+
+/* buffer memory allocated by EGL; peaks are high-water marks since the
+ * display or window was created */
+struct wl_egl_memory_usage {
+	uint64_t bytes;
+	uint64_t peak_bytes;
+	uint32_t surfaces;
+	uint32_t peak_surfaces;
+	uint32_t failures;	/* allocations that failed */
+};
+
+#define WL_EGL_MEMORY_MAX_FORMATS	8
+
+struct wl_egl_memory_stats {
+	struct wl_egl_memory_usage total;
+	struct wl_egl_memory_usage backends[WL_EGL_MEMORY_BACKENDS];
+	/* usage by pixel format, identified by wl_shm format codes */
+	uint32_t n_formats;
+	uint32_t formats[WL_EGL_MEMORY_MAX_FORMATS];
+	struct wl_egl_memory_usage by_format[WL_EGL_MEMORY_MAX_FORMATS];
+};
+
+#define WL_EGL_LATENCY_BUCKETS	32
+
+/* distribution of the time spent blocked at one point of the frame
+ * pipeline; bucket n counts the waits that lasted [2^n, 2^(n+1)) ns,
+ * the last one also counts everything longer */
+struct wl_egl_latency_stats {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t histogram[WL_EGL_LATENCY_BUCKETS];
+};
+
+struct wl_egl_frame_stats {
+	/* waiting for the GPU to finish rendering before attach */
+	struct wl_egl_latency_stats gpu_wait;
+	/* waiting for the compositor to consume the previous frame */
+	struct wl_egl_latency_stats throttle_wait;
+	/* waiting for the compositor to release a buffer */
+	struct wl_egl_latency_stats buffer_wait;
+	uint64_t buffers_allocated;	/* new ones, not from the cache */
+	uint64_t swaps;
+	/* swap rate measured over the last second or so */
+	double swaps_per_second;
+};
+
+/* outcome of a frame as reported by the compositor through the
+ * wp_presentation protocol, timestamps are in the clock_id domain */
+struct wl_egl_presentation {
+	uint64_t frame;		/* swap number, counted like frame_stats.swaps */
+	uint64_t swap_ns;	/* when eglSwapBuffers committed the frame */
+	uint64_t present_ns;	/* when the frame turned into light */
+	uint64_t msc;		/* vertical retrace counter at present_ns */
+	uint32_t refresh_ns;	/* output refresh period, 0 if unknown */
+	uint32_t flags;		/* wp_presentation_feedback kind bits */
+	int clock_id;
+	int discarded;		/* the frame was never shown */
+};
+
+/* largest buffer pool accepted by wl_egl_window_set_buffer_count */
+#define WL_EGL_WINDOW_MAX_BUFFERS	4
+
+/* maximum number of rectangles accepted by wl_egl_window_set_damage */
+#define WL_EGL_WINDOW_MAX_DAMAGE_RECTS	32
+
+/* Set the area of the window that changed since the previous frame, as
+ * n_rects rectangles of 4 ints (x, y, width, height) with the origin at
+ * the bottom left of the surface, like EGL_KHR_swap_buffers_with_damage.
+ * Applies to the next eglSwapBuffers only; without it, or with no
+ * rectangle or NULL rects, the whole surface is damaged. */
+void
+wl_egl_window_set_damage(struct wl_egl_window *egl_window,
+			 const int *rects, int n_rects);
+
+/* Age of the back buffer the next frame is rendered to, following
+ * EGL_EXT_buffer_age: the number of frames since its content was last
+ * presented, or 0 if its content is undefined. Valid once the surface
+ * is current and after each eglSwapBuffers. */
+int
+wl_egl_window_get_buffer_age(struct wl_egl_window *egl_window);
+
+/* Copy the frame pipeline statistics of the EGL surface created for this
+ * window. Counters are updated without locking, a snapshot taken while
+ * another thread swaps may be slightly inconsistent. Setting
+ * EGL_FRAME_STATS in the environment also dumps them to stderr when the
+ * surface is destroyed. */
+void
+wl_egl_window_get_frame_stats(struct wl_egl_window *egl_window,
+			      struct wl_egl_frame_stats *stats);
+
+/* Get the presentation feedback of the most recent frame the compositor
+ * reported on. Returns -1 if there is none yet, or if the compositor
+ * does not support wp_presentation. Feedback is received while EGL
+ * dispatches its events, usually during eglSwapBuffers. */
+int
+wl_egl_window_get_presentation(struct wl_egl_window *egl_window,
+			       struct wl_egl_presentation *presentation);
+
+/* Bound the number of buffers of the window. The pool only grows when no
+ * buffer is free for the next frame, up to max, and buffers the recent
+ * frames did not need are freed after a while, down to min. 0 selects
+ * the default bound, 2 and WL_EGL_WINDOW_MAX_BUFFERS. Returns -1 unless
+ * 2 <= min <= max <= WL_EGL_WINDOW_MAX_BUFFERS. Applies from the next
+ * frame. */
+int
+wl_egl_window_set_buffer_count(struct wl_egl_window *egl_window,
+			       int min, int max);
+
+/* Hint that the window should be scanned out directly from a display
+ * plane instead of being composited, typically because it is opaque and
+ * covers the whole output. Sent to the compositor on the next
+ * eglSwapBuffers; needs wl_gdl version 5 or later. */
+void
+wl_egl_window_set_bypass_hint(struct wl_egl_window *egl_window,
+			      int preferred);
+
+/* Whether the compositor currently scans the window out from a plane, as
+ * last reported while EGL dispatched its events. */
+int
+wl_egl_window_get_bypass_active(struct wl_egl_window *egl_window);
+
+/* Get the memory held by the buffers of the window. Buffers the window
+ * gave back to the display cache are only counted by the display. */
+void
+wl_egl_window_get_memory_usage(struct wl_egl_window *egl_window,
+			       struct wl_egl_memory_usage *usage);
+
+int
+wl_egl_display_get_buffer_cache_stats(struct wl_display *display,
+				      struct wl_egl_buffer_cache_stats *stats);
+
+/* Get the buffer memory allocated by EGL for the display, cached buffers
+ * included. Returns -1 if no EGL display was initialized for it. Setting
+ * EGL_MEMORY_LOG to a number of seconds also logs the totals to stderr
+ * as they change, at most that often. */
+int
+wl_egl_display_get_memory_stats(struct wl_display *display,
+				struct wl_egl_memory_stats *stats);
+
+#endif /* !WAYLAND_EGL_EXT_H */
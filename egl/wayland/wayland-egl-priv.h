@@ -2,6 +2,7 @@
 # define WAYLAND_EGL_PRIV_H
 
 #include "wayland-egl.h"
+#include "wayland-egl-ext.h"
 
 struct wl_egl_window {
 	struct wl_surface *surface;
@@ -11,6 +12,31 @@ struct wl_egl_window {
 	int dy;
 	int attached_width;
 	int attached_height;
+	int damage_rects[WL_EGL_WINDOW_MAX_DAMAGE_RECTS * 4];
+	int n_damage_rects;
+	int buffer_age;
+	struct wl_egl_frame_stats frame_stats;
+	struct wl_egl_presentation presentation;
+	int bypass_hint;
+	int bypass_active;
+	int min_buffers;
+	int max_buffers;
+	struct wl_egl_memory_usage memory_usage;
 };
 
+/* hooks registered by the EGL driver for each initialized display, so
+ * that the query functions of wayland-egl-ext.h can reach it */
+struct wl_egl_display {
+	struct wl_list link;
+	struct wl_display *display;
+	void *driver_private;
+	void (*get_buffer_cache_stats)(void *driver_private,
+				       struct wl_egl_buffer_cache_stats *stats);
+	void (*get_memory_stats)(void *driver_private,
+				 struct wl_egl_memory_stats *stats);
+};
+
+void wl_egl_display_register(struct wl_egl_display *egl_display);
+void wl_egl_display_unregister(struct wl_egl_display *egl_display);
+
 #endif /* !WAYLAND_EGL_PRIV_H */
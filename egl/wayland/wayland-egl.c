@@ -1,7 +1,12 @@
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "wayland-egl-priv.h"
 
+static pthread_mutex_t display_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct wl_list display_list = { &display_list, &display_list };
+
 WL_EXPORT struct wl_egl_window *
 wl_egl_window_create(struct wl_surface *surface,
 		     int width, int height)
@@ -15,6 +20,17 @@ wl_egl_window_create(struct wl_surface *surface,
 	egl_window->surface = surface;
 	egl_window->attached_width = 0;
 	egl_window->attached_height = 0;
+	egl_window->n_damage_rects = 0;
+	egl_window->buffer_age = 0;
+	memset(&egl_window->frame_stats, 0, sizeof (egl_window->frame_stats));
+	memset(&egl_window->presentation, 0,
+	       sizeof (egl_window->presentation));
+	egl_window->bypass_hint = 0;
+	egl_window->bypass_active = 0;
+	egl_window->min_buffers = 0;
+	egl_window->max_buffers = 0;
+	memset(&egl_window->memory_usage, 0,
+	       sizeof (egl_window->memory_usage));
 
 	wl_egl_window_resize(egl_window, width, height, 0, 0);
 
@@ -47,3 +63,159 @@ wl_egl_window_get_attached_size(struct wl_egl_window *egl_window,
 	if (height)
 		*height = egl_window->attached_height;
 }
+
+WL_EXPORT void
+wl_egl_window_set_damage(struct wl_egl_window *egl_window,
+			 const int *rects, int n_rects)
+{
+	/* no or too many rectangles, damage everything */
+	if (!rects || n_rects < 0 || n_rects > WL_EGL_WINDOW_MAX_DAMAGE_RECTS)
+		n_rects = 0;
+
+	if (n_rects)
+		memcpy(egl_window->damage_rects, rects,
+		       n_rects * 4 * sizeof (*rects));
+	egl_window->n_damage_rects = n_rects;
+}
+
+WL_EXPORT int
+wl_egl_window_get_buffer_age(struct wl_egl_window *egl_window)
+{
+	return egl_window->buffer_age;
+}
+
+WL_EXPORT void
+wl_egl_window_get_frame_stats(struct wl_egl_window *egl_window,
+			      struct wl_egl_frame_stats *stats)
+{
+	*stats = egl_window->frame_stats;
+}
+
+WL_EXPORT int
+wl_egl_window_get_presentation(struct wl_egl_window *egl_window,
+			       struct wl_egl_presentation *presentation)
+{
+	/* frames are numbered from 1 */
+	if (egl_window->presentation.frame == 0)
+		return -1;
+
+	*presentation = egl_window->presentation;
+
+	return 0;
+}
+
+WL_EXPORT int
+wl_egl_window_set_buffer_count(struct wl_egl_window *egl_window,
+			       int min, int max)
+{
+	int real_min = min ? min : 2;
+	int real_max = max ? max : WL_EGL_WINDOW_MAX_BUFFERS;
+
+	if (real_min < 2 || real_min > real_max ||
+	    real_max > WL_EGL_WINDOW_MAX_BUFFERS)
+		return -1;
+
+	egl_window->min_buffers = min;
+	egl_window->max_buffers = max;
+
+	return 0;
+}
+
+WL_EXPORT void
+wl_egl_window_get_memory_usage(struct wl_egl_window *egl_window,
+			       struct wl_egl_memory_usage *usage)
+{
+	*usage = egl_window->memory_usage;
+}
+
+WL_EXPORT void
+wl_egl_window_set_bypass_hint(struct wl_egl_window *egl_window,
+			      int preferred)
+{
+	egl_window->bypass_hint = !!preferred;
+}
+
+WL_EXPORT int
+wl_egl_window_get_bypass_active(struct wl_egl_window *egl_window)
+{
+	return __atomic_load_n(&egl_window->bypass_active, __ATOMIC_ACQUIRE);
+}
+
+WL_EXPORT void
+wl_egl_display_register(struct wl_egl_display *egl_display)
+{
+	pthread_mutex_lock(&display_list_lock);
+	wl_list_insert(&display_list, &egl_display->link);
+	pthread_mutex_unlock(&display_list_lock);
+}
+
+WL_EXPORT void
+wl_egl_display_unregister(struct wl_egl_display *egl_display)
+{
+	/* a headless display is registered with a NULL display, the link
+	 * tells whether it is in the list */
+	if (!egl_display->link.next)
+		return;
+
+	pthread_mutex_lock(&display_list_lock);
+	wl_list_remove(&egl_display->link);
+	pthread_mutex_unlock(&display_list_lock);
+
+	egl_display->link.next = NULL;
+	egl_display->display = NULL;
+}
+
+static struct wl_egl_display *
+lookup_display(struct wl_display *display)
+{
+	struct wl_egl_display *egl_display;
+
+	wl_list_for_each(egl_display, &display_list, link) {
+		if (egl_display->display == display)
+			return egl_display;
+	}
+
+	return NULL;
+}
+
+WL_EXPORT int
+wl_egl_display_get_buffer_cache_stats(struct wl_display *display,
+				      struct wl_egl_buffer_cache_stats *stats)
+{
+	struct wl_egl_display *egl_display;
+	int ret = -1;
+
+	pthread_mutex_lock(&display_list_lock);
+
+	egl_display = lookup_display(display);
+	if (egl_display && egl_display->get_buffer_cache_stats) {
+		egl_display->get_buffer_cache_stats(egl_display->driver_private,
+						    stats);
+		ret = 0;
+	}
+
+	pthread_mutex_unlock(&display_list_lock);
+
+	return ret;
+}
+
+WL_EXPORT int
+wl_egl_display_get_memory_stats(struct wl_display *display,
+				struct wl_egl_memory_stats *stats)
+{
+	struct wl_egl_display *egl_display;
+	int ret = -1;
+
+	pthread_mutex_lock(&display_list_lock);
+
+	egl_display = lookup_display(display);
+	if (egl_display && egl_display->get_memory_stats) {
+		egl_display->get_memory_stats(egl_display->driver_private,
+					      stats);
+		ret = 0;
+	}
+
+	pthread_mutex_unlock(&display_list_lock);
+
+	return ret;
+}
@@ -1,64 +1,88 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include <sys/mman.h>
 
 #include "wayland-wsegl.h"
 
+struct shm_pixmap {
+	struct wayland_shm_pool *pool;
+	size_t offset;
+	size_t size;
+};
+
 static gma_ret_t
 pixmap_destroy_shm(gma_pixmap_info_t *pixmap_info)
 {
-	int fd;
+	struct shm_pixmap *shm = pixmap_info->user_data;
 	gma_ret_t ret = GMA_SUCCESS;
 
-	munmap(pixmap_info->virt_addr,
-	       pixmap_info->height * pixmap_info->pitch);
-
-	fd = (int)pixmap_info->user_data;
-	if (close(fd) < 0)
+	if (munmap(pixmap_info->virt_addr, shm->size) < 0)
 		ret = GMA_ERR_FAILED;
 
+	wayland_shm_pool_free(shm->pool, shm->offset, shm->size);
+	wayland_shm_pool_unref(shm->pool);
+	free(shm);
+
 	return ret;
 }
 
+static int
+shm_buffer_stride(int width, const struct wayland_pixel_format *format)
+{
+	return align(width * format->bpp, format->bpp * 2);
+}
+
+size_t
+wayland_shm_buffer_size(int width, int height,
+			const struct wayland_pixel_format *format)
+{
+	size_t page_size = getpagesize();
+	size_t size = shm_buffer_stride(width, format) * height;
+
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
 static WSEGLError
-create_shm_pixmap(int width, int height,
+create_shm_pixmap(struct wayland_shm_pool *pool, int width, int height,
 		  const struct wayland_pixel_format *format,
 		  gma_pixmap_t *pixmap, gma_pixmap_info_t *pixmap_info)
 {
 	gma_pixmap_info_t info;
 	gma_pixmap_funcs_t funcs;
-	char filename[] = "/tmp/wayland-shm-XXXXXX";
+	struct shm_pixmap *shm;
 	void *data;
+	long offset;
 	int stride;
 	int size;
-	int fd;
-
-	fd = mkstemp(filename);
-	if (fd < 0) {
-		dbg("failed to create file for SHM buffer: %m");
-		return WSEGL_OUT_OF_MEMORY;
-	}
-
-	unlink(filename);
 
-	stride = align(width * format->bpp, format->bpp * 2);
+	stride = shm_buffer_stride(width, format);
 	size = height * stride;
 
-	if (fallocate(fd, 0, 0, size) < 0) {
-		dbg("failed to allocate %d bytes for SHM buffer: %m", size);
-		close(fd);
+	shm = malloc(sizeof (*shm));
+	if (!shm)
+		return WSEGL_OUT_OF_MEMORY;
+
+	offset = wayland_shm_pool_alloc(pool, size);
+	if (offset < 0) {
+		dbg("failed to allocate %d bytes for SHM buffer", size);
+		free(shm);
 		return WSEGL_OUT_OF_MEMORY;
 	}
 
-	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    pool->fd, offset);
 	if (data == MAP_FAILED) {
 		dbg("failed to map SHM buffer data: %m");
-		close(fd);
+		wayland_shm_pool_free(pool, offset, size);
+		free(shm);
 		return WSEGL_OUT_OF_MEMORY;
 	}
 
+	shm->pool = wayland_shm_pool_ref(pool);
+	shm->offset = offset;
+	shm->size = size;
+
 	info.type = GMA_PIXMAP_TYPE_VIRTUAL;
 	info.virt_addr = data;
 	info.phys_addr = 0;
@@ -66,13 +90,14 @@ create_shm_pixmap(int width, int height,
 	info.height = height;
 	info.pitch = stride;
 	info.format = format->gma_pf;
-	info.user_data = (void *)fd;
+	info.user_data = shm;
 
 	funcs.destroy = pixmap_destroy_shm;
 
 	if (gma_pixmap_alloc(&info, &funcs, pixmap) != GMA_SUCCESS) {
 		dbg("failed to allocate SHM pixmap");
 		pixmap_destroy_shm(&info);
+		return WSEGL_OUT_OF_MEMORY;
 	}
 
 	*pixmap_info = info;
@@ -145,8 +170,85 @@ create_gdl_pixmap(int width, int height,
 	return WSEGL_SUCCESS;
 }
 
+static void
+buffer_release(void *data, struct wl_buffer *wl_buffer)
+{
+	struct wayland_buffer *buffer = data;
+	struct wayland_display *display = buffer->display;
+
+	dbg("release buffer %d", buffer->id);
+
+	/* once unlocked, another thread may destroy the buffer */
+	__atomic_store_n(&buffer->lock, false, __ATOMIC_RELEASE);
+	wayland_release_notify(display);
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	buffer_release
+};
+
+/* buffer events are dispatched from the queue of the window using it,
+ * or all by the release thread when there is one */
+static void
+buffer_set_queue(struct wayland_buffer *buffer, struct wl_event_queue *queue)
+{
+	if (!buffer->wl_buffer)
+		return;
+
+	if (buffer->display->release.queue)
+		queue = buffer->display->release.queue;
+
+	buffer->wl_queue = queue;
+	wl_proxy_set_queue((struct wl_proxy *) buffer->wl_buffer, queue);
+}
+
+static bool
+gdl_has_create_buffer2(struct wayland_display *display)
+{
+	return wl_proxy_get_version((struct wl_proxy *) display->wl_gdl) >=
+		WL_GDL_CREATE_BUFFER2_SINCE_VERSION;
+}
+
+static struct wl_buffer *
+create_gdl_wl_buffer(struct wayland_display *display,
+		     struct wayland_buffer *buffer, int width, int height)
+{
+	if (!gdl_has_create_buffer2(display))
+		return wl_gdl_create_buffer(display->wl_gdl, buffer->id);
+
+	return wl_gdl_create_buffer2(display->wl_gdl, buffer->id, 0,
+				     width, height, buffer->pitch,
+				     buffer->format->gdl_pf);
+}
+
+/* take a buffer of the given size from the display cache, or NULL;
+ * scanout asks for a buffer not resized in place */
+struct wayland_buffer *
+wayland_reuse_buffer(struct wayland_display *display,
+		     struct wl_event_queue *queue, int width, int height,
+		     const struct wayland_pixel_format *format, bool scanout)
+{
+	struct wayland_buffer *buffer;
+
+	/* releases of cached buffers are queued on the display queue */
+	if (display->wl_queue)
+		wl_display_dispatch_queue_pending(display->wl_display,
+						  display->wl_queue);
+
+	buffer = wayland_buffer_cache_get(display, width, height, format,
+					  scanout);
+	if (buffer) {
+		dbg("reuse cached buffer %d", buffer->id);
+		buffer_set_queue(buffer, queue);
+	}
+
+	return buffer;
+}
+
 WSEGLError
-wayland_alloc_buffer(struct wayland_display *display, int width, int height,
+wayland_alloc_buffer(struct wayland_display *display,
+		     struct wayland_shm_pool *pool,
+		     struct wl_event_queue *queue, int width, int height,
 		     const struct wayland_pixel_format *format,
 		     struct wayland_buffer **out_buffer)
 {
@@ -161,47 +263,61 @@ wayland_alloc_buffer(struct wayland_display *display, int width, int height,
 		return WSEGL_OUT_OF_MEMORY;
 	}
 
-	if (display->wl_gdl)
-		err = create_gdl_pixmap(width, height, format, &pixmap, &pi);
+	buffer->display = display;
+
+	if (display->wl_shm)
+		err = create_shm_pixmap(pool, width, height, format,
+					&pixmap, &pi);
 	else
-		err = create_shm_pixmap(width, height, format, &pixmap, &pi);
+		err = create_gdl_pixmap(width, height, format, &pixmap, &pi);
 
 	if (err != WSEGL_SUCCESS) {
+		wayland_memory_failed(display, format);
 		free(buffer);
 		return WSEGL_OUT_OF_MEMORY;
 	}
 
 	err = wayland_bind_gma_buffer(display, buffer, pixmap);
 	if (err != WSEGL_SUCCESS) {
+		wayland_memory_failed(display, format);
 		gma_pixmap_release(&pixmap);
 		free(buffer);
 		return err;
 	}
 
-	if (display->wl_gdl) {
-		buffer->id = (gdl_surface_id_t)pi.user_data;
-		buffer->wl_buffer =
-			wl_gdl_create_buffer(display->wl_gdl, buffer->id);
-	} else {
-		struct wl_shm_pool *pool;
-
-		buffer->id = (int)pi.user_data;
-		pool = wl_shm_create_pool(display->wl_shm, buffer->id,
-					  pi.pitch * pi.height);
+	if (display->wl_shm) {
+		struct shm_pixmap *shm = pi.user_data;
 
+		buffer->id = shm->offset;
+		buffer->shm_pool = shm->pool;
+		buffer->shm_offset = shm->offset;
 		buffer->wl_buffer =
-			wl_shm_pool_create_buffer(pool, 0,
+			wl_shm_pool_create_buffer(shm->pool->wl_pool,
+						  shm->offset,
 						  pi.width, pi.height,
 						  pi.pitch, format->wl_pf);
+	} else {
+		buffer->id = (gdl_surface_id_t)pi.user_data;
 
-		wl_shm_pool_destroy(pool);
+		/* headless buffers are never shared */
+		if (display->wl_gdl)
+			buffer->wl_buffer =
+				create_gdl_wl_buffer(display, buffer,
+						     pi.width, pi.height);
 	}
 
-	if (!buffer->wl_buffer) {
+	if (!buffer->wl_buffer && !display->headless.enabled) {
 		wayland_destroy_buffer(display, buffer);
 		return WSEGL_OUT_OF_MEMORY;
 	}
 
+	wayland_memory_alloc(display, buffer);
+
+	if (buffer->wl_buffer)
+		wl_buffer_add_listener(buffer->wl_buffer, &buffer_listener,
+				       buffer);
+	buffer_set_queue(buffer, queue);
+
 	*out_buffer = buffer;
 
 	return WSEGL_SUCCESS;
@@ -217,6 +333,10 @@ wayland_destroy_buffer(struct wayland_display *display,
 	if (buffer->wl_buffer)
 		wl_buffer_destroy(buffer->wl_buffer);
 
+	wayland_timeline_unref(buffer->release_timeline);
+
+	wayland_memory_free(display, buffer);
+
 	wayland_unbind_buffer(display, buffer);
 
 	if (buffer->pixmap)
@@ -225,6 +345,81 @@ wayland_destroy_buffer(struct wayland_display *display,
 	free(buffer);
 }
 
+/* give a buffer that is no longer used by a window back to the display
+ * cache, or destroy it if it does not fit there */
+void
+wayland_release_buffer(struct wayland_display *display,
+		       struct wayland_buffer *buffer)
+{
+	if (buffer == NULL)
+		return;
+
+	/* frame numbers are only meaningful within a window */
+	buffer->frame = 0;
+	wayland_memory_set_owner(display, buffer, NULL);
+
+	/* the window queue may go away, a pending release must not */
+	buffer_set_queue(buffer, display->wl_queue);
+
+	if (!wayland_buffer_cache_put(display, buffer))
+		wayland_destroy_buffer(display, buffer);
+}
+
+/* Change the size of the wl_buffer exposed to the compositor without
+ * touching the underlying allocation. Returns WSEGL_BAD_DRAWABLE when the
+ * buffer has to be reallocated instead: either the new size does not fit
+ * in the allocation, or the backend cannot describe a buffer smaller than
+ * its surface (wl_gdl before version 2).
+ */
+WSEGLError
+wayland_resize_buffer(struct wayland_display *display,
+		      struct wayland_buffer *buffer, int width, int height)
+{
+	struct wl_buffer *wl_buffer;
+
+	if (buffer->width == width && buffer->height == height)
+		return WSEGL_SUCCESS;
+
+	if (width > buffer->alloc_width || height > buffer->alloc_height)
+		return WSEGL_BAD_DRAWABLE;
+
+	if (!buffer->wl_buffer) {
+		buffer->width = width;
+		buffer->height = height;
+		buffer->frame = 0;
+		return WSEGL_SUCCESS;
+	}
+
+	if (display->wl_gdl && !gdl_has_create_buffer2(display))
+		return WSEGL_BAD_DRAWABLE;
+
+	if (display->wl_gdl)
+		wl_buffer = create_gdl_wl_buffer(display, buffer,
+						 width, height);
+	else
+		wl_buffer = wl_shm_pool_create_buffer(buffer->shm_pool->wl_pool,
+						      buffer->shm_offset,
+						      width, height,
+						      buffer->pitch,
+						      buffer->format->wl_pf);
+	if (!wl_buffer)
+		return WSEGL_OUT_OF_MEMORY;
+
+	dbg("resize buffer %d from %dx%d to %dx%d", buffer->id,
+	    buffer->width, buffer->height, width, height);
+
+	wl_buffer_add_listener(wl_buffer, &buffer_listener, buffer);
+	wl_proxy_set_queue((struct wl_proxy *) wl_buffer, buffer->wl_queue);
+
+	wl_buffer_destroy(buffer->wl_buffer);
+	buffer->wl_buffer = wl_buffer;
+	buffer->width = width;
+	buffer->height = height;
+	buffer->frame = 0;
+
+	return WSEGL_SUCCESS;
+}
+
 WSEGLError
 wayland_bind_gma_buffer(struct wayland_display *display,
 			struct wayland_buffer *buffer,
@@ -254,6 +449,8 @@ wayland_bind_gma_buffer(struct wayland_display *display,
 
 	size = pixmap_info.pitch * pixmap_info.height;
 
+	pthread_mutex_lock(&display->pvr2d_lock);
+
 	if (pixmap_info.type == GMA_PIXMAP_TYPE_PHYSICAL) {
 		unsigned long page_addr = pixmap_info.phys_addr &
 			~(getpagesize() - 1);
@@ -269,6 +466,8 @@ wayland_bind_gma_buffer(struct wayland_display *display,
 				      size, NULL, &meminfo);
 	}
 
+	pthread_mutex_unlock(&display->pvr2d_lock);
+
 	if (pvr_rc != PVR2D_OK) {
 		dbg("failed to wrap surface buffer: %s",
 		    pvr2d_strerror(pvr_rc));
@@ -281,6 +480,8 @@ wayland_bind_gma_buffer(struct wayland_display *display,
 	buffer->width = pixmap_info.width;
 	buffer->height = pixmap_info.height;
 	buffer->pitch = pixmap_info.pitch;
+	buffer->alloc_width = pixmap_info.width;
+	buffer->alloc_height = pixmap_info.height;
 	buffer->meminfo = meminfo;
 	buffer->pixmap = pixmap;
 	buffer->format = format;
@@ -296,7 +497,13 @@ wayland_unbind_buffer(struct wayland_display *display,
 		return;
 
 	if (buffer->meminfo) {
+		/* the fence thread may still wait on it */
+		wayland_fence_flush_meminfo(display, buffer->meminfo);
+
+		pthread_mutex_lock(&display->pvr2d_lock);
 		PVR2DMemFree(display->pvr2d_context, buffer->meminfo);
+		pthread_mutex_unlock(&display->pvr2d_lock);
+
 		buffer->meminfo = NULL;
 	}
 
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+
+#include "wayland-wsegl.h"
+
+static size_t
+buffer_size(struct wayland_buffer *buffer)
+{
+	return buffer->pitch * buffer->alloc_height;
+}
+
+static void
+cache_evict(struct wayland_display *display, size_t max_size)
+{
+	struct wayland_buffer_cache *cache = &display->cache;
+	struct wayland_buffer *buffer;
+
+	/* least recently used buffers are at the tail of the list */
+	while (cache->size > max_size && !wl_list_empty(&cache->buffers)) {
+		buffer = wl_container_of(cache->buffers.prev, buffer, link);
+
+		wl_list_remove(&buffer->link);
+		cache->size -= buffer_size(buffer);
+		cache->evictions++;
+
+		dbg("evict cached buffer %d", buffer->id);
+
+		wayland_destroy_buffer(display, buffer);
+	}
+}
+
+void
+wayland_buffer_cache_init(struct wayland_display *display)
+{
+	struct wayland_buffer_cache *cache = &display->cache;
+	long max_size;
+
+	max_size = debug_get_num_option("EGL_BUFFER_CACHE_SIZE",
+					BUFFER_CACHE_SIZE);
+	if (max_size < 0)
+		max_size = 0;
+
+	pthread_mutex_init(&cache->lock, NULL);
+	wl_list_init(&cache->buffers);
+	cache->max_size = (size_t) max_size * 1024;
+}
+
+void
+wayland_buffer_cache_fini(struct wayland_display *display)
+{
+	struct wayland_buffer_cache *cache = &display->cache;
+
+	dbg("buffer cache: %llu hits, %llu misses, %llu evictions",
+	    (unsigned long long) cache->hits,
+	    (unsigned long long) cache->misses,
+	    (unsigned long long) cache->evictions);
+
+	cache_evict(display, 0);
+	pthread_mutex_destroy(&cache->lock);
+}
+
+/* take an unused buffer of the given size and format out of the cache;
+ * buffers still held by the compositor are skipped, and so are buffers
+ * resized in place when asked for plane scanout, which they do not suit */
+struct wayland_buffer *
+wayland_buffer_cache_get(struct wayland_display *display,
+			 int width, int height,
+			 const struct wayland_pixel_format *format,
+			 bool scanout)
+{
+	struct wayland_buffer_cache *cache = &display->cache;
+	struct wayland_buffer *buffer, *found = NULL;
+
+	pthread_mutex_lock(&cache->lock);
+
+	wl_list_for_each(buffer, &cache->buffers, link) {
+		if (buffer->format == format &&
+		    buffer->width == width &&
+		    buffer->height == height &&
+		    (!scanout || (buffer->width == buffer->alloc_width &&
+				  buffer->height == buffer->alloc_height)) &&
+		    !wayland_buffer_is_locked(buffer)) {
+			found = buffer;
+			break;
+		}
+	}
+
+	if (found) {
+		wl_list_remove(&found->link);
+		cache->size -= buffer_size(found);
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return found;
+}
+
+/* hand an unused buffer over to the cache; returns false if the buffer
+ * does not fit in the cache budget, in which case the caller keeps the
+ * ownership of the buffer */
+bool
+wayland_buffer_cache_put(struct wayland_display *display,
+			 struct wayland_buffer *buffer)
+{
+	struct wayland_buffer_cache *cache = &display->cache;
+	size_t size = buffer_size(buffer);
+
+	if (size > cache->max_size)
+		return false;
+
+	pthread_mutex_lock(&cache->lock);
+
+	wl_list_insert(&cache->buffers, &buffer->link);
+	cache->size += size;
+
+	cache_evict(display, cache->max_size);
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return true;
+}
+
+void
+wayland_buffer_cache_get_stats(void *data,
+			       struct wl_egl_buffer_cache_stats *stats)
+{
+	struct wayland_display *display = data;
+	struct wayland_buffer_cache *cache = &display->cache;
+
+	pthread_mutex_lock(&cache->lock);
+
+	stats->size = cache->size;
+	stats->max_size = cache->max_size;
+	stats->count = wl_list_length(&cache->buffers);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->evictions = cache->evictions;
+
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,144 @@
+/* Throughput of the pixel conversion routines used by eglCopyBuffers
+ * and pbuffer copies, for each supported format pair.
+ *
+ * usage: convert-bench [width height [iterations]]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wayland-wsegl.h"
+
+static const WSEGLPixelFormat src_formats[] = {
+	WSEGL_PIXELFORMAT_ARGB8888,
+	WSEGL_PIXELFORMAT_XRGB8888,
+	WSEGL_PIXELFORMAT_RGB565,
+	WSEGL_PIXELFORMAT_ARGB1555,
+	WSEGL_PIXELFORMAT_ARGB4444,
+};
+
+static const gma_pixel_format_t dst_formats[] = {
+	GMA_PF_ARGB_32,
+	GMA_PF_RGB_32,
+	GMA_PF_RGB_16,
+	GMA_PF_ARGB_16_1555,
+	GMA_PF_ARGB_16_4444,
+	GMA_PF_A8,
+};
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+static double
+get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+run(wayland_convert_func_t func,
+    const struct wayland_pixel_format *src_pf,
+    const struct wayland_pixel_format *dst_pf,
+    const uint8_t *src, uint8_t *dst,
+    int width, int height, int iterations)
+{
+	int src_pitch = align(width * src_pf->bpp, 64);
+	int dst_pitch = align(width * dst_pf->bpp, 64);
+	double start, elapsed;
+
+	/* warm up the caches */
+	wayland_convert_pixels(func, dst, dst_pitch, src, src_pitch,
+			       width, height);
+
+	start = get_time();
+	for (int i = 0; i < iterations; i++)
+		wayland_convert_pixels(func, dst, dst_pitch, src, src_pitch,
+				       width, height);
+	elapsed = get_time() - start;
+
+	/* bytes read plus bytes written */
+	return (double) iterations * width * height *
+		(src_pf->bpp + dst_pf->bpp) / elapsed / 1e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int width = 1280, height = 720, iterations = 50;
+	uint8_t *src, *dst;
+
+	if (argc >= 3) {
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+	}
+	if (argc >= 4)
+		iterations = atoi(argv[3]);
+
+	if (width <= 0 || height <= 0 || iterations <= 0) {
+		fprintf(stderr, "usage: %s [width height [iterations]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	src = malloc(align(width * 4, 64) * height);
+	dst = malloc(align(width * 4, 64) * height);
+	if (!src || !dst)
+		return 1;
+
+	for (int i = 0; i < align(width * 4, 64) * height; i++)
+		src[i] = rand();
+
+	printf("%dx%d, %d iterations, GB/s (read + written)\n",
+	       width, height, iterations);
+	printf("%-10s %-10s %8s %8s %8s\n",
+	       "source", "dest", "scalar", "simd", "dither");
+
+	for (unsigned s = 0; s < ARRAY_LENGTH(src_formats); s++) {
+		for (unsigned d = 0; d < ARRAY_LENGTH(dst_formats); d++) {
+			const struct wayland_pixel_format *src_pf, *dst_pf;
+			wayland_convert_func_t scalar, simd, dither;
+
+			src_pf = convert_wsegl_pixel_format(src_formats[s]);
+			dst_pf = convert_gma_pixel_format(dst_formats[d]);
+
+			scalar = wayland_get_convert_func(src_pf, dst_pf,
+							  CONVERT_NO_SIMD);
+			if (!scalar)
+				continue;
+
+			simd = wayland_get_convert_func(src_pf, dst_pf, 0);
+			dither = wayland_get_convert_func(src_pf, dst_pf,
+							  CONVERT_DITHER |
+							  CONVERT_NO_SIMD);
+
+			printf("%-10s %-10s %8.2f", src_pf->name, dst_pf->name,
+			       run(scalar, src_pf, dst_pf, src, dst,
+				   width, height, iterations));
+
+			if (simd != scalar)
+				printf(" %8.2f", run(simd, src_pf, dst_pf,
+						     src, dst, width, height,
+						     iterations));
+			else
+				printf(" %8s", "-");
+
+			if (dither != scalar)
+				printf(" %8.2f", run(dither, src_pf, dst_pf,
+						     src, dst, width, height,
+						     iterations));
+			else
+				printf(" %8s", "-");
+
+			printf("\n");
+		}
+	}
+
+	free(src);
+	free(dst);
+
+	return 0;
+}
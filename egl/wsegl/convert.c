@@ -0,0 +1,597 @@
+#include <string.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+# include <tmmintrin.h>
+#endif
+
+#include "wayland-wsegl.h"
+
+/* 4x4 ordered dither matrix, values 0..15 */
+static const uint8_t bayer[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+static inline uint32_t
+dither_channel(uint32_t c, int bits, int bias)
+{
+	c += bias >> (bits - 4);
+	if (c > 255)
+		c = 255;
+
+	return c >> (8 - bits);
+}
+
+static void
+copy_row_32(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	memcpy(dst, src, width * 4);
+}
+
+static void
+copy_row_16(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	memcpy(dst, src, width * 2);
+}
+
+static void
+copy_row_8(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	memcpy(dst, src, width);
+}
+
+static void
+xrgb8888_to_argb8888(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+	uint32_t *d = (uint32_t *) dst;
+
+	for (int x = 0; x < width; x++)
+		d[x] = s[x] | 0xff000000;
+}
+
+static void
+argb8888_to_rgb565(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+	uint16_t *d = (uint16_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+
+		d[x] = ((p >> 8) & 0xf800) |
+		       ((p >> 5) & 0x07e0) |
+		       ((p >> 3) & 0x001f);
+	}
+}
+
+static void
+argb8888_to_rgb565_dither(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+	uint16_t *d = (uint16_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+		int bias = bayer[y & 3][x & 3];
+
+		d[x] = dither_channel((p >> 16) & 0xff, 5, bias) << 11 |
+		       dither_channel((p >> 8) & 0xff, 6, bias) << 5 |
+		       dither_channel(p & 0xff, 5, bias);
+	}
+}
+
+static void
+argb8888_to_argb1555(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+	uint16_t *d = (uint16_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+
+		d[x] = ((p >> 16) & 0x8000) |
+		       ((p >> 9) & 0x7c00) |
+		       ((p >> 6) & 0x03e0) |
+		       ((p >> 3) & 0x001f);
+	}
+}
+
+static void
+xrgb8888_to_argb1555(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	uint16_t *d = (uint16_t *) dst;
+
+	argb8888_to_argb1555(dst, src, width, y);
+
+	for (int x = 0; x < width; x++)
+		d[x] |= 0x8000;
+}
+
+static void
+argb8888_to_argb1555_dither(uint8_t *dst, const uint8_t *src,
+			    int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+	uint16_t *d = (uint16_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+		int bias = bayer[y & 3][x & 3];
+
+		d[x] = ((p >> 16) & 0x8000) |
+		       dither_channel((p >> 16) & 0xff, 5, bias) << 10 |
+		       dither_channel((p >> 8) & 0xff, 5, bias) << 5 |
+		       dither_channel(p & 0xff, 5, bias);
+	}
+}
+
+static void
+argb8888_to_argb4444(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+	uint16_t *d = (uint16_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+
+		d[x] = ((p >> 16) & 0xf000) |
+		       ((p >> 12) & 0x0f00) |
+		       ((p >> 8) & 0x00f0) |
+		       ((p >> 4) & 0x000f);
+	}
+}
+
+static void
+xrgb8888_to_argb4444(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	uint16_t *d = (uint16_t *) dst;
+
+	argb8888_to_argb4444(dst, src, width, y);
+
+	for (int x = 0; x < width; x++)
+		d[x] |= 0xf000;
+}
+
+static void
+argb8888_to_argb4444_dither(uint8_t *dst, const uint8_t *src,
+			    int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+	uint16_t *d = (uint16_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+		int bias = bayer[y & 3][x & 3];
+
+		d[x] = dither_channel(p >> 24, 4, bias) << 12 |
+		       dither_channel((p >> 16) & 0xff, 4, bias) << 8 |
+		       dither_channel((p >> 8) & 0xff, 4, bias) << 4 |
+		       dither_channel(p & 0xff, 4, bias);
+	}
+}
+
+static void
+argb8888_to_a8(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint32_t *s = (const uint32_t *) src;
+
+	for (int x = 0; x < width; x++)
+		dst[x] = s[x] >> 24;
+}
+
+static void
+rgb565_to_argb8888(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint16_t *s = (const uint16_t *) src;
+	uint32_t *d = (uint32_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+		uint32_t r = (p >> 11) & 0x1f;
+		uint32_t g = (p >> 5) & 0x3f;
+		uint32_t b = p & 0x1f;
+
+		d[x] = 0xff000000 |
+		       ((r << 3 | r >> 2) << 16) |
+		       ((g << 2 | g >> 4) << 8) |
+		       (b << 3 | b >> 2);
+	}
+}
+
+static void
+argb1555_to_argb8888(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint16_t *s = (const uint16_t *) src;
+	uint32_t *d = (uint32_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+		uint32_t r = (p >> 10) & 0x1f;
+		uint32_t g = (p >> 5) & 0x1f;
+		uint32_t b = p & 0x1f;
+
+		d[x] = (p & 0x8000 ? 0xff000000 : 0) |
+		       ((r << 3 | r >> 2) << 16) |
+		       ((g << 3 | g >> 2) << 8) |
+		       (b << 3 | b >> 2);
+	}
+}
+
+static void
+argb4444_to_argb8888(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const uint16_t *s = (const uint16_t *) src;
+	uint32_t *d = (uint32_t *) dst;
+
+	for (int x = 0; x < width; x++) {
+		uint32_t p = s[x];
+
+		d[x] = ((p & 0xf000) * 0x11000) |
+		       ((p & 0x0f00) * 0x1100) |
+		       ((p & 0x00f0) * 0x110) |
+		       ((p & 0x000f) * 0x11);
+	}
+}
+
+/* 16-bit to 16-bit conversions go through ARGB8888, in chunks whose width
+ * is a multiple of 4 so that the dither pattern is kept */
+#define VIA_CHUNK	64
+
+static inline void
+convert_via_argb8888(uint8_t *dst, const uint8_t *src, int width, int y,
+		     wayland_convert_func_t expand, wayland_convert_func_t pack)
+{
+	uint32_t tmp[VIA_CHUNK];
+
+	for (int x = 0; x < width; x += VIA_CHUNK) {
+		int n = width - x < VIA_CHUNK ? width - x : VIA_CHUNK;
+
+		expand((uint8_t *) tmp, src + x * 2, n, y);
+		pack(dst + x * 2, (const uint8_t *) tmp, n, y);
+	}
+}
+
+#define VIA_ARGB8888(name, expand, pack)				\
+static void								\
+name(uint8_t *dst, const uint8_t *src, int width, int y)		\
+{									\
+	convert_via_argb8888(dst, src, width, y, expand, pack);		\
+}
+
+VIA_ARGB8888(rgb565_to_argb1555, rgb565_to_argb8888, xrgb8888_to_argb1555)
+VIA_ARGB8888(rgb565_to_argb1555_dither, rgb565_to_argb8888,
+	     argb8888_to_argb1555_dither)
+VIA_ARGB8888(rgb565_to_argb4444, rgb565_to_argb8888, xrgb8888_to_argb4444)
+VIA_ARGB8888(rgb565_to_argb4444_dither, rgb565_to_argb8888,
+	     argb8888_to_argb4444_dither)
+VIA_ARGB8888(argb1555_to_rgb565, argb1555_to_argb8888, argb8888_to_rgb565)
+VIA_ARGB8888(argb1555_to_argb4444, argb1555_to_argb8888, argb8888_to_argb4444)
+VIA_ARGB8888(argb1555_to_argb4444_dither, argb1555_to_argb8888,
+	     argb8888_to_argb4444_dither)
+VIA_ARGB8888(argb4444_to_rgb565, argb4444_to_argb8888, argb8888_to_rgb565)
+VIA_ARGB8888(argb4444_to_argb1555, argb4444_to_argb8888, argb8888_to_argb1555)
+
+#ifdef __SSE2__
+static void
+xrgb8888_to_argb8888_sse2(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	int x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i *) (src + x * 4));
+
+		_mm_storeu_si128((__m128i *) (dst + x * 4),
+				 _mm_or_si128(p, alpha));
+	}
+
+	xrgb8888_to_argb8888(dst + x * 4, src + x * 4, width - x, y);
+}
+
+/* pack the low 16 bits of each 32-bit lane; packs_epi32 saturates so
+ * the values are sign extended first to go through unchanged */
+static inline __m128i
+pack_lo16(__m128i a, __m128i b)
+{
+	a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+	b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+
+	return _mm_packs_epi32(a, b);
+}
+
+static inline __m128i
+argb8888_to_rgb565_4(__m128i p)
+{
+	const __m128i mask_r = _mm_set1_epi32(0xf800);
+	const __m128i mask_g = _mm_set1_epi32(0x07e0);
+	const __m128i mask_b = _mm_set1_epi32(0x001f);
+
+	return _mm_or_si128(
+		_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 8), mask_r),
+			     _mm_and_si128(_mm_srli_epi32(p, 5), mask_g)),
+		_mm_and_si128(_mm_srli_epi32(p, 3), mask_b));
+}
+
+static void
+argb8888_to_rgb565_sse2(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *) (src + x * 4));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)
+					     (src + x * 4 + 16));
+
+		_mm_storeu_si128((__m128i *) (dst + x * 2),
+				 pack_lo16(argb8888_to_rgb565_4(p0),
+					   argb8888_to_rgb565_4(p1)));
+	}
+
+	argb8888_to_rgb565(dst + x * 2, src + x * 4, width - x, y);
+}
+
+static inline __m128i
+argb8888_to_argb1555_4(__m128i p)
+{
+	const __m128i mask_a = _mm_set1_epi32(0x8000);
+	const __m128i mask_r = _mm_set1_epi32(0x7c00);
+	const __m128i mask_g = _mm_set1_epi32(0x03e0);
+	const __m128i mask_b = _mm_set1_epi32(0x001f);
+
+	return _mm_or_si128(
+		_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), mask_a),
+			     _mm_and_si128(_mm_srli_epi32(p, 9), mask_r)),
+		_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 6), mask_g),
+			     _mm_and_si128(_mm_srli_epi32(p, 3), mask_b)));
+}
+
+static void
+argb8888_to_argb1555_sse2(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *) (src + x * 4));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)
+					     (src + x * 4 + 16));
+
+		_mm_storeu_si128((__m128i *) (dst + x * 2),
+				 pack_lo16(argb8888_to_argb1555_4(p0),
+					   argb8888_to_argb1555_4(p1)));
+	}
+
+	argb8888_to_argb1555(dst + x * 2, src + x * 4, width - x, y);
+}
+
+static inline __m128i
+argb8888_to_argb4444_4(__m128i p)
+{
+	const __m128i mask_a = _mm_set1_epi32(0xf000);
+	const __m128i mask_r = _mm_set1_epi32(0x0f00);
+	const __m128i mask_g = _mm_set1_epi32(0x00f0);
+	const __m128i mask_b = _mm_set1_epi32(0x000f);
+
+	return _mm_or_si128(
+		_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), mask_a),
+			     _mm_and_si128(_mm_srli_epi32(p, 12), mask_r)),
+		_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 8), mask_g),
+			     _mm_and_si128(_mm_srli_epi32(p, 4), mask_b)));
+}
+
+static void
+argb8888_to_argb4444_sse2(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *) (src + x * 4));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)
+					     (src + x * 4 + 16));
+
+		_mm_storeu_si128((__m128i *) (dst + x * 2),
+				 pack_lo16(argb8888_to_argb4444_4(p0),
+					   argb8888_to_argb4444_4(p1)));
+	}
+
+	argb8888_to_argb4444(dst + x * 2, src + x * 4, width - x, y);
+}
+
+static void
+rgb565_to_argb8888_sse2(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	const __m128i mask_5 = _mm_set1_epi32(0x1f);
+	const __m128i mask_6 = _mm_set1_epi32(0x3f);
+	int x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i p = _mm_loadl_epi64((const __m128i *) (src + x * 2));
+		__m128i r, g, b;
+
+		p = _mm_unpacklo_epi16(p, zero);
+
+		r = _mm_and_si128(_mm_srli_epi32(p, 11), mask_5);
+		g = _mm_and_si128(_mm_srli_epi32(p, 5), mask_6);
+		b = _mm_and_si128(p, mask_5);
+
+		/* replicate the top bits into the low bits */
+		r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+		g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+		b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+
+		p = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(r, 16)),
+				 _mm_or_si128(_mm_slli_epi32(g, 8), b));
+
+		_mm_storeu_si128((__m128i *) (dst + x * 4), p);
+	}
+
+	rgb565_to_argb8888(dst + x * 4, src + x * 2, width - x, y);
+}
+#endif
+
+#ifdef __SSSE3__
+static void
+argb8888_to_a8_ssse3(uint8_t *dst, const uint8_t *src, int width, int y)
+{
+	/* gather the alpha bytes of 4 pixels into the low dword */
+	const __m128i shuffle = _mm_setr_epi8(3, 7, 11, 15,
+					      -1, -1, -1, -1, -1, -1, -1, -1,
+					      -1, -1, -1, -1);
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m128i *s = (const __m128i *) (src + x * 4);
+		__m128i a0 = _mm_shuffle_epi8(_mm_loadu_si128(s), shuffle);
+		__m128i a1 = _mm_shuffle_epi8(_mm_loadu_si128(s + 1), shuffle);
+		__m128i a2 = _mm_shuffle_epi8(_mm_loadu_si128(s + 2), shuffle);
+		__m128i a3 = _mm_shuffle_epi8(_mm_loadu_si128(s + 3), shuffle);
+
+		a0 = _mm_unpacklo_epi32(a0, a1);
+		a2 = _mm_unpacklo_epi32(a2, a3);
+
+		_mm_storeu_si128((__m128i *) (dst + x),
+				 _mm_unpacklo_epi64(a0, a2));
+	}
+
+	argb8888_to_a8(dst + x, src + x * 4, width - x, y);
+}
+#endif
+
+#ifdef __SSE2__
+# define SSE2(func)	func##_sse2
+#else
+# define SSE2(func)	NULL
+#endif
+
+#ifdef __SSSE3__
+# define SSSE3(func)	func##_ssse3
+#else
+# define SSSE3(func)	NULL
+#endif
+
+struct convert_entry {
+	WSEGLPixelFormat src;
+	gma_pixel_format_t dst;
+	wayland_convert_func_t scalar;
+	wayland_convert_func_t simd;
+	wayland_convert_func_t dither;
+};
+
+static const struct convert_entry convert_table[] = {
+	{ WSEGL_PIXELFORMAT_ARGB8888, GMA_PF_ARGB_32,
+	  copy_row_32, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB8888, GMA_PF_RGB_32,
+	  copy_row_32, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB8888, GMA_PF_RGB_16,
+	  argb8888_to_rgb565, SSE2(argb8888_to_rgb565),
+	  argb8888_to_rgb565_dither },
+	{ WSEGL_PIXELFORMAT_ARGB8888, GMA_PF_ARGB_16_1555,
+	  argb8888_to_argb1555, SSE2(argb8888_to_argb1555),
+	  argb8888_to_argb1555_dither },
+	{ WSEGL_PIXELFORMAT_ARGB8888, GMA_PF_ARGB_16_4444,
+	  argb8888_to_argb4444, SSE2(argb8888_to_argb4444),
+	  argb8888_to_argb4444_dither },
+	{ WSEGL_PIXELFORMAT_ARGB8888, GMA_PF_A8,
+	  argb8888_to_a8, SSSE3(argb8888_to_a8), NULL },
+
+	{ WSEGL_PIXELFORMAT_XRGB8888, GMA_PF_RGB_32,
+	  copy_row_32, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_XRGB8888, GMA_PF_ARGB_32,
+	  xrgb8888_to_argb8888, SSE2(xrgb8888_to_argb8888), NULL },
+	{ WSEGL_PIXELFORMAT_XRGB8888, GMA_PF_RGB_16,
+	  argb8888_to_rgb565, SSE2(argb8888_to_rgb565),
+	  argb8888_to_rgb565_dither },
+	{ WSEGL_PIXELFORMAT_XRGB8888, GMA_PF_ARGB_16_1555,
+	  xrgb8888_to_argb1555, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_XRGB8888, GMA_PF_ARGB_16_4444,
+	  xrgb8888_to_argb4444, NULL, NULL },
+
+	{ WSEGL_PIXELFORMAT_RGB565, GMA_PF_RGB_16,
+	  copy_row_16, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_RGB565, GMA_PF_ARGB_32,
+	  rgb565_to_argb8888, SSE2(rgb565_to_argb8888), NULL },
+	{ WSEGL_PIXELFORMAT_RGB565, GMA_PF_RGB_32,
+	  rgb565_to_argb8888, SSE2(rgb565_to_argb8888), NULL },
+	{ WSEGL_PIXELFORMAT_RGB565, GMA_PF_ARGB_16_1555,
+	  rgb565_to_argb1555, NULL, rgb565_to_argb1555_dither },
+	{ WSEGL_PIXELFORMAT_RGB565, GMA_PF_ARGB_16_4444,
+	  rgb565_to_argb4444, NULL, rgb565_to_argb4444_dither },
+
+	{ WSEGL_PIXELFORMAT_ARGB1555, GMA_PF_ARGB_16_1555,
+	  copy_row_16, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB1555, GMA_PF_ARGB_32,
+	  argb1555_to_argb8888, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB1555, GMA_PF_RGB_32,
+	  argb1555_to_argb8888, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB1555, GMA_PF_RGB_16,
+	  argb1555_to_rgb565, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB1555, GMA_PF_ARGB_16_4444,
+	  argb1555_to_argb4444, NULL, argb1555_to_argb4444_dither },
+
+	{ WSEGL_PIXELFORMAT_ARGB4444, GMA_PF_ARGB_16_4444,
+	  copy_row_16, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB4444, GMA_PF_ARGB_32,
+	  argb4444_to_argb8888, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB4444, GMA_PF_RGB_32,
+	  argb4444_to_argb8888, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB4444, GMA_PF_RGB_16,
+	  argb4444_to_rgb565, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_ARGB4444, GMA_PF_ARGB_16_1555,
+	  argb4444_to_argb1555, NULL, NULL },
+
+	{ WSEGL_PIXELFORMAT_88, GMA_PF_AY16,
+	  copy_row_16, NULL, NULL },
+	{ WSEGL_PIXELFORMAT_8, GMA_PF_A8,
+	  copy_row_8, NULL, NULL },
+};
+
+#define CONVERT_COUNT (sizeof (convert_table) / sizeof (*convert_table))
+
+/* look up the row conversion from src to dst; dithering only applies to
+ * conversions that drop color precision. Returns NULL if the formats
+ * cannot be converted. */
+wayland_convert_func_t
+wayland_get_convert_func(const struct wayland_pixel_format *src,
+			 const struct wayland_pixel_format *dst,
+			 enum wayland_convert_flags flags)
+{
+	for (unsigned i = 0; i < CONVERT_COUNT; i++) {
+		const struct convert_entry *entry = &convert_table[i];
+
+		if (entry->src != src->wsegl_pf || entry->dst != dst->gma_pf)
+			continue;
+
+		if ((flags & CONVERT_DITHER) && entry->dither)
+			return entry->dither;
+
+		if (!(flags & CONVERT_NO_SIMD) && entry->simd)
+			return entry->simd;
+
+		return entry->scalar;
+	}
+
+	return NULL;
+}
+
+void
+wayland_convert_pixels(wayland_convert_func_t func,
+		       void *dst, int dst_pitch,
+		       const void *src, int src_pitch,
+		       int width, int height)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	for (int y = 0; y < height; y++) {
+		func(d, s, width, y);
+		d += dst_pitch;
+		s += src_pitch;
+	}
+}
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "wayland-wsegl.h"
+
+/* EGL_HEADLESS_DUMP names a file the frames are written to, or a command
+ * they are piped to when it starts with '|'. Frames are raw rows in the
+ * window format without padding, the geometry is logged when it changes.
+ */
+void
+wayland_headless_init(struct wayland_display *display)
+{
+	struct wayland_headless *headless = &display->headless;
+	const char *path;
+
+	pthread_mutex_init(&headless->lock, NULL);
+
+	path = getenv("EGL_HEADLESS_DUMP");
+	if (!path || !*path)
+		return;
+
+	if (path[0] == '|') {
+		headless->dump = popen(path + 1, "w");
+		headless->dump_pipe = true;
+	} else {
+		headless->dump = fopen(path, "wb");
+	}
+
+	if (!headless->dump)
+		err("failed to open frame dump %s: %s", path, strerror(errno));
+}
+
+/* a write to a pipe whose reader is gone raises SIGPIPE, which would kill
+ * the application: block it on this thread while dumping, and consume
+ * the one the write raised, if any */
+static void
+block_sigpipe(sigset_t *old_mask, bool *was_pending)
+{
+	sigset_t mask, pending;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, old_mask);
+
+	sigpending(&pending);
+	*was_pending = sigismember(&pending, SIGPIPE);
+}
+
+static void
+unblock_sigpipe(const sigset_t *old_mask, bool was_pending)
+{
+	static const struct timespec zero;
+	sigset_t mask, pending;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+
+	sigpending(&pending);
+	if (!was_pending && sigismember(&pending, SIGPIPE))
+		sigtimedwait(&mask, NULL, &zero);
+
+	pthread_sigmask(SIG_SETMASK, old_mask, NULL);
+}
+
+/* closing a pipe flushes what is left in the buffer, which raises
+ * SIGPIPE as well */
+static void
+close_dump(struct wayland_headless *headless)
+{
+	sigset_t old_mask;
+	bool sigpipe_pending;
+
+	if (headless->dump_pipe) {
+		block_sigpipe(&old_mask, &sigpipe_pending);
+		pclose(headless->dump);
+		unblock_sigpipe(&old_mask, sigpipe_pending);
+	} else {
+		fclose(headless->dump);
+	}
+
+	headless->dump = NULL;
+}
+
+void
+wayland_headless_fini(struct wayland_display *display)
+{
+	struct wayland_headless *headless = &display->headless;
+
+	if (headless->dump)
+		close_dump(headless);
+
+	pthread_mutex_destroy(&headless->lock);
+}
+
+static void
+dump_frame(struct wayland_headless *headless, struct wayland_buffer *buffer)
+{
+	const uint8_t *src = buffer->meminfo->pBase;
+	size_t size = buffer->width * buffer->format->bpp;
+	sigset_t old_mask;
+	bool sigpipe_pending = false;
+
+	pthread_mutex_lock(&headless->lock);
+
+	if (!headless->dump)
+		goto out;
+
+	if (headless->dump_pipe)
+		block_sigpipe(&old_mask, &sigpipe_pending);
+
+	if (buffer->width != headless->width ||
+	    buffer->height != headless->height ||
+	    buffer->format != headless->format) {
+		err("headless: dumping %dx%d %s frames", buffer->width,
+		    buffer->height, buffer->format->name);
+		headless->width = buffer->width;
+		headless->height = buffer->height;
+		headless->format = buffer->format;
+	}
+
+	for (int y = 0; y < buffer->height; y++, src += buffer->pitch) {
+		if (fwrite(src, 1, size, headless->dump) != size) {
+			err("failed to dump frame, stopping");
+			close_dump(headless);
+			break;
+		}
+	}
+
+	if (headless->dump_pipe)
+		unblock_sigpipe(&old_mask, sigpipe_pending);
+
+out:
+	pthread_mutex_unlock(&headless->lock);
+}
+
+/* stand in for the compositor: the buffer is done with as soon as its
+ * rendering completes, so it is never locked and the window keeps
+ * reusing it */
+void
+wayland_headless_present(struct wayland_display *display,
+			 struct wayland_window *window,
+			 struct wayland_buffer *buffer)
+{
+	struct wl_egl_frame_stats *stats = &window->egl_window->frame_stats;
+	PVR2DERROR pvr2d_rc;
+	uint64_t start;
+
+	start = get_time_ns();
+	pthread_mutex_lock(&display->pvr2d_lock);
+	pvr2d_rc = PVR2DQueryBlitsComplete(display->pvr2d_context,
+					   buffer->meminfo, 1);
+	pthread_mutex_unlock(&display->pvr2d_lock);
+	if (pvr2d_rc != PVR2D_OK)
+		dbg("failed to wait for rendering");
+	wayland_latency_add(&stats->gpu_wait, start);
+
+	dump_frame(&display->headless, buffer);
+}
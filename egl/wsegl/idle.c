@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wayland-wsegl.h"
+
+/* default time without swap before a window frees its spare buffers */
+#define IDLE_TIMEOUT_MS		5000
+
+/* bounds of the interval the idle thread checks the windows at */
+#define IDLE_TICK_MIN_MS	100
+#define IDLE_TICK_MAX_MS	1000
+
+/* Destroy the unlocked buffers of a window until at most target are left,
+ * least recently presented first. The front buffer is still attached to
+ * the surface and EGL keeps rendering to the back buffer it was handed
+ * by GetDrawableParameters, so both always stay. Returns the number of
+ * buffers freed. */
+int
+wayland_window_free_buffers(struct wayland_display *display,
+			    struct wayland_window *window, int target)
+{
+	int freed = 0;
+
+	while (window->num_buffers > target) {
+		struct wayland_buffer *buffer;
+		int index = -1;
+
+		for (int i = 0; i < window->num_buffers; i++) {
+			buffer = window->bufferpool[i];
+
+			if (buffer == window->buffers[BUFFER_ID_FRONT] ||
+			    buffer == window->buffers[BUFFER_ID_BACK] ||
+			    wayland_buffer_is_locked(buffer))
+				continue;
+
+			if (index < 0 ||
+			    buffer->frame < window->bufferpool[index]->frame)
+				index = i;
+		}
+
+		if (index < 0)
+			break;
+
+		buffer = window->bufferpool[index];
+		window->bufferpool[index] =
+			window->bufferpool[--window->num_buffers];
+		window->bufferpool[window->num_buffers] = NULL;
+
+		dbg("free buffer %d, %d left", buffer->id,
+		    window->num_buffers);
+		wayland_destroy_buffer(display, buffer);
+		freed++;
+	}
+
+	return freed;
+}
+
+/* a window busy in EGL is not idle, it is skipped */
+static void
+idle_check_window(struct wayland_display *display,
+		  struct wayland_window *window, uint64_t now)
+{
+	struct wayland_idle *idle = &display->idle;
+	bool hidden, expired;
+
+	if (pthread_mutex_trylock(&window->lock) != 0)
+		return;
+
+	/* the window queue belongs to the render thread, events are not
+	 * dispatched here: visibility comes from the release thread or the
+	 * last swap, and explicit sync releases need no event */
+	hidden = !__atomic_load_n(&window->visible, __ATOMIC_ACQUIRE);
+	expired = now - window->last_swap_ns >= idle->timeout_ns;
+
+	if ((hidden || expired) &&
+	    wayland_window_free_buffers(display, window, 0) > 0)
+		dbg("window %s, spare buffers freed",
+		    hidden ? "hidden" : "idle");
+
+	pthread_mutex_unlock(&window->lock);
+}
+
+static void *
+idle_thread(void *data)
+{
+	struct wayland_display *display = data;
+	struct wayland_idle *idle = &display->idle;
+	struct wayland_window *window;
+	uint64_t tick_ns, deadline;
+	struct timespec ts;
+
+	tick_ns = idle->timeout_ns / 4;
+	if (tick_ns < IDLE_TICK_MIN_MS * 1000000ull)
+		tick_ns = IDLE_TICK_MIN_MS * 1000000ull;
+	if (tick_ns > IDLE_TICK_MAX_MS * 1000000ull)
+		tick_ns = IDLE_TICK_MAX_MS * 1000000ull;
+
+	pthread_mutex_lock(&idle->lock);
+
+	while (!idle->stop) {
+		if (!__atomic_exchange_n(&idle->wake, false,
+					 __ATOMIC_ACQ_REL)) {
+			deadline = get_time_ns() + tick_ns;
+			ts.tv_sec = deadline / 1000000000;
+			ts.tv_nsec = deadline % 1000000000;
+
+			/* spurious wakeup, or stop */
+			if (pthread_cond_timedwait(&idle->cond, &idle->lock,
+						   &ts) != ETIMEDOUT &&
+			    !__atomic_exchange_n(&idle->wake, false,
+						 __ATOMIC_ACQ_REL))
+				continue;
+		}
+
+		if (idle->stop)
+			break;
+
+		wl_list_for_each(window, &idle->windows, idle_link)
+			idle_check_window(display, window, get_time_ns());
+
+		wayland_memory_tick(display);
+	}
+
+	pthread_mutex_unlock(&idle->lock);
+
+	dbg("idle thread exiting");
+
+	return NULL;
+}
+
+/* EGL_IDLE_TIMEOUT sets the time in milliseconds a window can go without
+ * swapping before its spare buffers are freed, 0 disables the policy */
+void
+wayland_idle_init(struct wayland_display *display)
+{
+	struct wayland_idle *idle = &display->idle;
+	pthread_condattr_t attr;
+
+	pthread_mutex_init(&idle->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&idle->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	wl_list_init(&idle->windows);
+
+	idle->timeout_ns = debug_get_num_option("EGL_IDLE_TIMEOUT",
+						IDLE_TIMEOUT_MS) * 1000000ull;
+}
+
+void
+wayland_idle_fini(struct wayland_display *display)
+{
+	struct wayland_idle *idle = &display->idle;
+
+	if (idle->running) {
+		pthread_mutex_lock(&idle->lock);
+		idle->stop = true;
+		pthread_cond_signal(&idle->cond);
+		pthread_mutex_unlock(&idle->lock);
+
+		pthread_join(idle->thread, NULL);
+		idle->running = false;
+	}
+
+	pthread_cond_destroy(&idle->cond);
+	pthread_mutex_destroy(&idle->lock);
+}
+
+/* the thread starts with the first window */
+void
+wayland_window_idle_init(struct wayland_display *display,
+			 struct wayland_window *window)
+{
+	struct wayland_idle *idle = &display->idle;
+
+	window->visible = true;
+	window->last_swap_ns = get_time_ns();
+
+	if (idle->timeout_ns == 0)
+		return;
+
+	pthread_mutex_lock(&idle->lock);
+
+	wl_list_insert(&idle->windows, &window->idle_link);
+
+	if (!idle->running) {
+		if (pthread_create(&idle->thread, NULL,
+				   idle_thread, display) == 0)
+			idle->running = true;
+		else
+			err("failed to start idle thread");
+	}
+
+	pthread_mutex_unlock(&idle->lock);
+}
+
+/* once this returns the idle thread no longer looks at the window */
+void
+wayland_window_idle_fini(struct wayland_display *display,
+			 struct wayland_window *window)
+{
+	struct wayland_idle *idle = &display->idle;
+
+	if (idle->timeout_ns == 0)
+		return;
+
+	pthread_mutex_lock(&idle->lock);
+	wl_list_remove(&window->idle_link);
+	pthread_mutex_unlock(&idle->lock);
+}
+
+/* have the windows checked now rather than on the next tick; called
+ * from event handlers, possibly on the release thread, so the lock is
+ * not taken and a missed wakeup only delays the check by a tick */
+void
+wayland_idle_wake(struct wayland_display *display)
+{
+	struct wayland_idle *idle = &display->idle;
+
+	__atomic_store_n(&idle->wake, true, __ATOMIC_RELEASE);
+	pthread_cond_signal(&idle->cond);
+}
@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "wayland-wsegl.h"
+
+static void
+usage_add(struct wl_egl_memory_usage *usage, size_t size)
+{
+	usage->bytes += size;
+	usage->surfaces++;
+
+	if (usage->bytes > usage->peak_bytes)
+		usage->peak_bytes = usage->bytes;
+	if (usage->surfaces > usage->peak_surfaces)
+		usage->peak_surfaces = usage->surfaces;
+}
+
+static void
+usage_sub(struct wl_egl_memory_usage *usage, size_t size)
+{
+	usage->bytes -= size;
+	usage->surfaces--;
+}
+
+/* formats get a slot on first use, there are fewer renderable formats
+ * than slots */
+static struct wl_egl_memory_usage *
+format_usage(struct wl_egl_memory_stats *stats,
+	     const struct wayland_pixel_format *format)
+{
+	uint32_t i;
+
+	for (i = 0; i < stats->n_formats; i++)
+		if (stats->formats[i] == format->wl_pf)
+			return &stats->by_format[i];
+
+	if (i == WL_EGL_MEMORY_MAX_FORMATS)
+		return NULL;
+
+	stats->formats[i] = format->wl_pf;
+	stats->n_formats++;
+
+	return &stats->by_format[i];
+}
+
+/* print the usage if it changed since the last line, and the interval
+ * elapsed unless forced */
+static void
+memory_flush_log(struct wayland_display *display, bool force)
+{
+	struct wayland_memory *memory = &display->memory;
+	const struct wl_egl_memory_usage *gdl, *shm;
+	uint64_t now;
+
+	if (!memory->log_pending)
+		return;
+
+	now = get_time_ns();
+	if (!force && now - memory->last_log_ns < memory->log_interval_ns)
+		return;
+
+	memory->last_log_ns = now;
+	memory->log_pending = false;
+	gdl = &memory->stats.backends[WL_EGL_MEMORY_GDL];
+	shm = &memory->stats.backends[WL_EGL_MEMORY_SHM];
+
+	err("memory: gdl %llu KiB in %u surfaces (peak %llu KiB), "
+	    "shm %llu KiB in %u surfaces (peak %llu KiB), %u failures",
+	    (unsigned long long) gdl->bytes / 1024, gdl->surfaces,
+	    (unsigned long long) gdl->peak_bytes / 1024,
+	    (unsigned long long) shm->bytes / 1024, shm->surfaces,
+	    (unsigned long long) shm->peak_bytes / 1024,
+	    memory->stats.total.failures);
+}
+
+/* a change within the interval is printed by a later call, or by the
+ * next tick of the idle thread */
+static void
+memory_log(struct wayland_display *display)
+{
+	struct wayland_memory *memory = &display->memory;
+
+	if (!memory->log_interval_ns)
+		return;
+
+	memory->log_pending = true;
+	memory_flush_log(display, false);
+}
+
+/* EGL_MEMORY_LOG sets the minimum interval in seconds between two log
+ * lines of the buffer memory in use, which are only printed when that
+ * changes; a change held back is printed once the interval elapsed, or
+ * at the latest when the display closes. 0 disables them */
+void
+wayland_memory_init(struct wayland_display *display)
+{
+	struct wayland_memory *memory = &display->memory;
+	long interval;
+
+	pthread_mutex_init(&memory->lock, NULL);
+
+	interval = debug_get_num_option("EGL_MEMORY_LOG", 0);
+	if (interval > 0)
+		memory->log_interval_ns = interval * 1000000000ull;
+}
+
+void
+wayland_memory_fini(struct wayland_display *display)
+{
+	memory_flush_log(display, true);
+	pthread_mutex_destroy(&display->memory.lock);
+}
+
+/* called periodically, prints a change held back by the interval */
+void
+wayland_memory_tick(struct wayland_display *display)
+{
+	struct wayland_memory *memory = &display->memory;
+
+	pthread_mutex_lock(&memory->lock);
+	memory_flush_log(display, false);
+	pthread_mutex_unlock(&memory->lock);
+}
+
+/* account a buffer newly allocated by wayland_alloc_buffer */
+void
+wayland_memory_alloc(struct wayland_display *display,
+		     struct wayland_buffer *buffer)
+{
+	struct wayland_memory *memory = &display->memory;
+	struct wl_egl_memory_usage *usage;
+
+	buffer->mem_size = buffer->pitch * buffer->alloc_height;
+	buffer->mem_backend = buffer->shm_pool ?
+		WL_EGL_MEMORY_SHM : WL_EGL_MEMORY_GDL;
+
+	pthread_mutex_lock(&memory->lock);
+
+	usage_add(&memory->stats.total, buffer->mem_size);
+	usage_add(&memory->stats.backends[buffer->mem_backend],
+		  buffer->mem_size);
+
+	usage = format_usage(&memory->stats, buffer->format);
+	if (usage)
+		usage_add(usage, buffer->mem_size);
+
+	memory_log(display);
+
+	pthread_mutex_unlock(&memory->lock);
+}
+
+void
+wayland_memory_free(struct wayland_display *display,
+		    struct wayland_buffer *buffer)
+{
+	struct wayland_memory *memory = &display->memory;
+	struct wl_egl_memory_usage *usage;
+
+	if (!buffer->mem_size)
+		return;
+
+	pthread_mutex_lock(&memory->lock);
+
+	if (buffer->mem_owner)
+		usage_sub(buffer->mem_owner, buffer->mem_size);
+	buffer->mem_owner = NULL;
+
+	usage_sub(&memory->stats.total, buffer->mem_size);
+	usage_sub(&memory->stats.backends[buffer->mem_backend],
+		  buffer->mem_size);
+
+	usage = format_usage(&memory->stats, buffer->format);
+	if (usage)
+		usage_sub(usage, buffer->mem_size);
+
+	memory_log(display);
+
+	pthread_mutex_unlock(&memory->lock);
+
+	buffer->mem_size = 0;
+}
+
+void
+wayland_memory_failed(struct wayland_display *display,
+		      const struct wayland_pixel_format *format)
+{
+	struct wayland_memory *memory = &display->memory;
+	struct wl_egl_memory_usage *usage;
+
+	pthread_mutex_lock(&memory->lock);
+
+	memory->stats.total.failures++;
+	memory->stats.backends[display->wl_shm ?
+			       WL_EGL_MEMORY_SHM :
+			       WL_EGL_MEMORY_GDL].failures++;
+
+	usage = format_usage(&memory->stats, format);
+	if (usage)
+		usage->failures++;
+
+	pthread_mutex_unlock(&memory->lock);
+}
+
+/* attribute the memory of a buffer to a window, or to nobody once it
+ * leaves the window for the cache */
+void
+wayland_memory_set_owner(struct wayland_display *display,
+			 struct wayland_buffer *buffer,
+			 struct wl_egl_memory_usage *owner)
+{
+	struct wayland_memory *memory = &display->memory;
+
+	if (!buffer->mem_size || buffer->mem_owner == owner)
+		return;
+
+	pthread_mutex_lock(&memory->lock);
+
+	if (buffer->mem_owner)
+		usage_sub(buffer->mem_owner, buffer->mem_size);
+	if (owner)
+		usage_add(owner, buffer->mem_size);
+
+	buffer->mem_owner = owner;
+
+	pthread_mutex_unlock(&memory->lock);
+}
+
+void
+wayland_memory_get_stats(void *data, struct wl_egl_memory_stats *stats)
+{
+	struct wayland_display *display = data;
+	struct wayland_memory *memory = &display->memory;
+
+	pthread_mutex_lock(&memory->lock);
+	*stats = memory->stats;
+	pthread_mutex_unlock(&memory->lock);
+}
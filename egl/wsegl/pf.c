@@ -2,21 +2,41 @@
 
 #include "wayland-wsegl.h"
 
-#define PF(pf_g, pf_wl, pf_egl, bpp, has_alpha, renderable) \
+#define PF(pf_g, pf_wl, pf_egl, pf_2d, bpp, has_alpha, renderable) \
 	{ #pf_egl, \
 		GDL_PF_##pf_g, GMA_PF_##pf_g, \
 		WL_SHM_FORMAT_##pf_wl, \
 		WSEGL_PIXELFORMAT_##pf_egl, \
-		bpp, has_alpha, renderable }
+		PVR2D_##pf_2d, \
+		bpp, has_alpha, renderable, false }
+
+/* video formats only exist as GDL surfaces, bpp is for the first plane */
+#define YUV(pf_g, pf_wl, pf_bpp) \
+	{ .name = #pf_g, \
+	  .gdl_pf = GDL_PF_##pf_g, \
+	  .wl_pf = WL_SHM_FORMAT_##pf_wl, \
+	  .bpp = pf_bpp, \
+	  .yuv = true }
 
 static const struct wayland_pixel_format pixel_formats[] = {
-	PF(ARGB_32,       ARGB8888,  ARGB8888,  4,  true,   true),
-	PF(RGB_32,        XRGB8888,  XRGB8888,  4,  false,  true),
-	PF(ARGB_16_1555,  ARGB1555,  ARGB1555,  2,  true,   true),
-	PF(ARGB_16_4444,  ARGB4444,  ARGB4444,  2,  true,   true),
-	PF(RGB_16,        RGB565,    RGB565,    2,  false,  true),
-	PF(AY16,          C8,        88,        2,  true,   false),
-	PF(A8,            C8,        8,         1,  true,   false),
+	PF(ARGB_32,       ARGB8888,  ARGB8888,  ARGB8888,  4,  true,   true),
+	PF(RGB_32,        XRGB8888,  XRGB8888,  ARGB8888,  4,  false,  true),
+	PF(ARGB_16_1555,  ARGB1555,  ARGB1555,  ARGB1555,  2,  true,   true),
+	PF(ARGB_16_4444,  ARGB4444,  ARGB4444,  ARGB4444,  2,  true,   true),
+	PF(RGB_16,        RGB565,    RGB565,    RGB565,    2,  false,  true),
+	PF(AY16,          C8,        88,        U88,       2,  true,   false),
+	PF(A8,            C8,        8,         ALPHA8,    1,  true,   false),
+
+	YUV(YUY2,         YUYV,      2),
+	YUV(UYVY,         UYVY,      2),
+	YUV(YVYU,         YVYU,      2),
+	YUV(VYUY,         VYUY,      2),
+	YUV(NV12,         NV12,      1),
+	YUV(NV16,         NV16,      1),
+	YUV(I420,         YUV420,    1),
+	YUV(YV12,         YVU420,    1),
+	YUV(I422,         YUV422,    1),
+	YUV(YV16,         YVU422,    1),
 };
 
 #define PF_COUNT (sizeof (pixel_formats) / sizeof (*pixel_formats))
@@ -35,7 +55,7 @@ const struct wayland_pixel_format *
 convert_gma_pixel_format(gma_pixel_format_t pf)
 {
 	for (unsigned i = 0; i < PF_COUNT; i++)
-		if (pixel_formats[i].gma_pf == pf)
+		if (!pixel_formats[i].yuv && pixel_formats[i].gma_pf == pf)
 			return &pixel_formats[i];
 
 	return NULL;
@@ -45,7 +65,7 @@ const struct wayland_pixel_format *
 convert_wsegl_pixel_format(WSEGLPixelFormat pf)
 {
 	for (unsigned i = 0; i < PF_COUNT; i++)
-		if (pixel_formats[i].wsegl_pf == pf)
+		if (!pixel_formats[i].yuv && pixel_formats[i].wsegl_pf == pf)
 			return &pixel_formats[i];
 
 	return NULL;
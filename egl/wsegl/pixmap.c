@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixmap.h"
+
+/* a blit to a native pixmap the GPU may still be working on; the wrapped
+ * pixmap is kept until the blit is known to be complete */
+struct pixmap_copy {
+	struct wl_list link;
+	struct wayland_buffer buffer;
+};
+
+/* pbuffer copies have no display, their flags only come from the
+ * environment and are read once */
+static pthread_once_t pbuffer_once = PTHREAD_ONCE_INIT;
+static enum wayland_convert_flags pbuffer_convert_flags;
+
+static enum wayland_convert_flags
+env_convert_flags(void)
+{
+	return debug_get_bool_option("EGL_DITHER", false) ? CONVERT_DITHER : 0;
+}
+
+static void
+pbuffer_setup(void)
+{
+	pbuffer_convert_flags = env_convert_flags();
+}
+
+static void
+retire_copies(struct wayland_display *display, gma_pixmap_t pixmap,
+	      bool wait)
+{
+	struct pixmap_copy *copy, *tmp;
+	struct wl_list done;
+	PVR2DERROR pvr2d_rc;
+
+	wl_list_init(&done);
+
+	pthread_mutex_lock(&display->pvr2d_lock);
+
+	wl_list_for_each_safe(copy, tmp, &display->pixmap_copies, link) {
+		if (pixmap && copy->buffer.pixmap != pixmap)
+			continue;
+
+		pvr2d_rc = PVR2DQueryBlitsComplete(display->pvr2d_context,
+						   copy->buffer.meminfo, wait);
+		if (pvr2d_rc == PVR2DERROR_BLT_NOTCOMPLETE)
+			continue;
+
+		if (pvr2d_rc != PVR2D_OK)
+			dbg("failed to wait for pixmap copy: %s",
+			    pvr2d_strerror(pvr2d_rc));
+
+		wl_list_remove(&copy->link);
+		wl_list_insert(&done, &copy->link);
+	}
+
+	pthread_mutex_unlock(&display->pvr2d_lock);
+
+	/* unbinding takes the lock itself */
+	wl_list_for_each_safe(copy, tmp, &done, link) {
+		wayland_unbind_buffer(display, &copy->buffer);
+		free(copy);
+	}
+}
+
+void
+wayland_pixmap_init(struct wayland_display *display)
+{
+	wl_list_init(&display->pixmap_copies);
+
+	display->sync_copies = debug_get_bool_option("EGL_SYNC_COPY", false);
+
+	display->convert_flags |= env_convert_flags();
+}
+
+void
+wayland_pixmap_fini(struct wayland_display *display)
+{
+	retire_copies(display, NULL, true);
+}
+
+/* wait for the copies to the given pixmap, or all pixmaps if NULL, to be
+ * complete so that their content can be accessed by the CPU */
+void
+wayland_wait_pixmap_copies(struct wayland_display *display,
+			   gma_pixmap_t pixmap)
+{
+	retire_copies(display, pixmap, true);
+}
+
+static bool
+can_blit(const struct wayland_pixel_format *src,
+	 const struct wayland_pixel_format *dst)
+{
+	if (src == dst)
+		return true;
+
+	/* the blitter converts between RGB formats, but would leave the
+	 * alpha channel of an opaque source undefined */
+	if (!src->renderable || !dst->renderable)
+		return false;
+
+	if (!src->has_alpha && dst->has_alpha)
+		return false;
+
+	return true;
+}
+
+static WSEGLError
+blit_copy(struct wayland_display *display, struct wayland_buffer *src,
+	  struct pixmap_copy *copy, int width, int height)
+{
+	struct wayland_buffer *dst = &copy->buffer;
+	PVR2DBLTINFO blt;
+	PVR2DERROR pvr2d_rc;
+
+	memset(&blt, 0, sizeof (blt));
+
+	blt.CopyCode = PVR2DROPcopy;
+	blt.BlitFlags = PVR2D_BLIT_DISABLE_ALL;
+
+	blt.pSrcMemInfo = src->meminfo;
+	blt.SrcStride = src->pitch;
+	blt.SrcFormat = src->format->pvr2d_pf;
+	blt.SrcSurfWidth = src->width;
+	blt.SrcSurfHeight = src->height;
+	blt.SizeX = width;
+	blt.SizeY = height;
+
+	blt.pDstMemInfo = dst->meminfo;
+	blt.DstStride = dst->pitch;
+	blt.DstFormat = dst->format->pvr2d_pf;
+	blt.DstSurfWidth = dst->width;
+	blt.DstSurfHeight = dst->height;
+	blt.DSizeX = width;
+	blt.DSizeY = height;
+
+	pthread_mutex_lock(&display->pvr2d_lock);
+
+	pvr2d_rc = PVR2DBlt(display->pvr2d_context, &blt);
+	if (pvr2d_rc == PVR2D_OK)
+		wl_list_insert(&display->pixmap_copies, &copy->link);
+
+	pthread_mutex_unlock(&display->pvr2d_lock);
+
+	if (pvr2d_rc != PVR2D_OK) {
+		dbg("failed to blit to pixmap: %s", pvr2d_strerror(pvr2d_rc));
+		return WSEGL_BAD_MATCH;
+	}
+
+	if (display->sync_copies)
+		retire_copies(display, dst->pixmap, true);
+
+	return WSEGL_SUCCESS;
+}
+
+static WSEGLError
+cpu_copy(struct wayland_display *display, struct wayland_buffer *src,
+	 struct wayland_buffer *dst, int width, int height)
+{
+	wayland_convert_func_t convert;
+	PVR2DERROR pvr2d_rc;
+
+	convert = wayland_get_convert_func(src->format, dst->format,
+					   display->convert_flags);
+	if (!convert) {
+		dbg("cannot convert %s to %s", src->format->name,
+		    dst->format->name);
+		return WSEGL_BAD_MATCH;
+	}
+
+	/* rendering to the source must be done before reading it */
+	pthread_mutex_lock(&display->pvr2d_lock);
+	pvr2d_rc = PVR2DQueryBlitsComplete(display->pvr2d_context,
+					   src->meminfo, 1);
+	pthread_mutex_unlock(&display->pvr2d_lock);
+	if (pvr2d_rc != PVR2D_OK)
+		dbg("failed to wait for source buffer");
+
+	wayland_convert_pixels(convert, dst->meminfo->pBase, dst->pitch,
+			       src->meminfo->pBase, src->pitch,
+			       width, height);
+
+	return WSEGL_SUCCESS;
+}
+
+/* copy a pbuffer, whose stride is given in pixels, to a native pixmap
+ * with the CPU, converting the pixel format as needed */
+WSEGLError
+wayland_copy_pbuffer_to_pixmap(const void *addr,
+			       int width, int height, int stride,
+			       WSEGLPixelFormat pixel_format,
+			       gma_pixmap_t pixmap)
+{
+	const struct wayland_pixel_format *src, *dst;
+	wayland_convert_func_t convert;
+	gma_pixmap_info_t pixmap_info;
+
+	if (gma_pixmap_get_info(pixmap, &pixmap_info) != GMA_SUCCESS) {
+		dbg("failed to get gma pixmap info");
+		return WSEGL_BAD_NATIVE_PIXMAP;
+	}
+
+	src = convert_wsegl_pixel_format(pixel_format);
+	dst = convert_gma_pixel_format(pixmap_info.format);
+	if (!src || !dst) {
+		dbg("unsupported pbuffer or pixmap format");
+		return WSEGL_BAD_NATIVE_PIXMAP;
+	}
+
+	pthread_once(&pbuffer_once, pbuffer_setup);
+	convert = wayland_get_convert_func(src, dst, pbuffer_convert_flags);
+	if (!convert) {
+		dbg("cannot convert %s to %s", src->name, dst->name);
+		return WSEGL_BAD_MATCH;
+	}
+
+	if (width > (int) pixmap_info.width)
+		width = pixmap_info.width;
+	if (height > (int) pixmap_info.height)
+		height = pixmap_info.height;
+
+	wayland_convert_pixels(convert, pixmap_info.virt_addr,
+			       pixmap_info.pitch, addr, stride * src->bpp,
+			       width, height);
+
+	return WSEGL_SUCCESS;
+}
+
+/* copy the content of a buffer to a native pixmap, with the 2D core when
+ * it can handle the formats or with the CPU otherwise. GPU copies are
+ * asynchronous unless EGL_SYNC_COPY is set, see
+ * wayland_wait_pixmap_copies. */
+WSEGLError
+wayland_copy_to_pixmap(struct wayland_display *display,
+		       struct wayland_buffer *src, gma_pixmap_t pixmap)
+{
+	struct pixmap_copy *copy;
+	int width, height;
+	WSEGLError err;
+
+	/* reclaim the copies that are done */
+	retire_copies(display, NULL, false);
+
+	copy = calloc(1, sizeof (*copy));
+	if (!copy)
+		return WSEGL_OUT_OF_MEMORY;
+
+	err = wayland_bind_gma_buffer(display, &copy->buffer, pixmap);
+	if (err != WSEGL_SUCCESS) {
+		free(copy);
+		return err;
+	}
+
+	width = src->width < copy->buffer.width ?
+		src->width : copy->buffer.width;
+	height = src->height < copy->buffer.height ?
+		src->height : copy->buffer.height;
+
+	dbg("copy %dx%d %s to %s pixmap", width, height,
+	    src->format->name, copy->buffer.format->name);
+
+	if (can_blit(src->format, copy->buffer.format)) {
+		err = blit_copy(display, src, copy, width, height);
+		if (err == WSEGL_SUCCESS)
+			return WSEGL_SUCCESS;
+	}
+
+	/* keep CPU writes ordered with earlier blits to the pixmap */
+	wayland_wait_pixmap_copies(display, pixmap);
+
+	err = cpu_copy(display, src, &copy->buffer, width, height);
+
+	wayland_unbind_buffer(display, &copy->buffer);
+	free(copy);
+
+	return err;
+}
@@ -0,0 +1,22 @@
+#ifndef WAYLAND_WSEGL_PIXMAP_H
+# define WAYLAND_WSEGL_PIXMAP_H
+
+#include "wayland-wsegl.h"
+
+void wayland_pixmap_init(struct wayland_display *display);
+
+void wayland_pixmap_fini(struct wayland_display *display);
+
+WSEGLError wayland_copy_to_pixmap(struct wayland_display *display,
+				  struct wayland_buffer *src,
+				  gma_pixmap_t pixmap);
+
+void wayland_wait_pixmap_copies(struct wayland_display *display,
+				gma_pixmap_t pixmap);
+
+WSEGLError wayland_copy_pbuffer_to_pixmap(const void *addr,
+					  int width, int height, int stride,
+					  WSEGLPixelFormat pixel_format,
+					  gma_pixmap_t pixmap);
+
+#endif /* !WAYLAND_WSEGL_PIXMAP_H */
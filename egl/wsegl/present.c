@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wayland-wsegl.h"
+
+struct presentation_feedback {
+	struct wayland_window *window;
+	struct wp_presentation_feedback *feedback;
+	uint64_t frame;
+	uint64_t swap_ns;
+	int clock_id;
+	struct wl_list link;
+};
+
+/* assumed refresh period until the compositor reports one */
+#define DEFAULT_REFRESH_NS	16666667ull
+
+static uint64_t
+get_presentation_time(struct wayland_display *display)
+{
+	struct timespec ts;
+	clock_gettime(display->presentation_clock, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+feedback_done(struct presentation_feedback *feedback,
+	      const struct wl_egl_presentation *presentation)
+{
+	struct wl_egl_window *egl_window = feedback->window->egl_window;
+
+	/* never go back to an older frame */
+	if (presentation->frame > egl_window->presentation.frame)
+		egl_window->presentation = *presentation;
+
+	wp_presentation_feedback_destroy(feedback->feedback);
+	wl_list_remove(&feedback->link);
+	free(feedback);
+}
+
+static void
+feedback_sync_output(void *data,
+		     struct wp_presentation_feedback *wp_feedback,
+		     struct wl_output *output)
+{
+}
+
+static void
+feedback_presented(void *data,
+		   struct wp_presentation_feedback *wp_feedback,
+		   uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+		   uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo,
+		   uint32_t flags)
+{
+	struct presentation_feedback *feedback = data;
+	struct wl_egl_presentation presentation;
+	uint64_t sec = ((uint64_t) tv_sec_hi << 32) | tv_sec_lo;
+
+	presentation.frame = feedback->frame;
+	presentation.swap_ns = feedback->swap_ns;
+	presentation.present_ns = sec * 1000000000ull + tv_nsec;
+	presentation.msc = ((uint64_t) seq_hi << 32) | seq_lo;
+	presentation.refresh_ns = refresh;
+	presentation.flags = flags;
+	presentation.clock_id = feedback->clock_id;
+	presentation.discarded = 0;
+
+	dbg("frame %llu presented after %llu us, msc %llu",
+	    (unsigned long long) presentation.frame,
+	    (unsigned long long) (presentation.present_ns -
+				  presentation.swap_ns) / 1000,
+	    (unsigned long long) presentation.msc);
+
+	feedback_done(feedback, &presentation);
+}
+
+static void
+feedback_discarded(void *data,
+		   struct wp_presentation_feedback *wp_feedback)
+{
+	struct presentation_feedback *feedback = data;
+	struct wl_egl_presentation presentation;
+
+	memset(&presentation, 0, sizeof (presentation));
+	presentation.frame = feedback->frame;
+	presentation.swap_ns = feedback->swap_ns;
+	presentation.clock_id = feedback->clock_id;
+	presentation.discarded = 1;
+
+	dbg("frame %llu discarded", (unsigned long long) presentation.frame);
+
+	feedback_done(feedback, &presentation);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+	.sync_output = feedback_sync_output,
+	.presented = feedback_presented,
+	.discarded = feedback_discarded,
+};
+
+void
+wayland_window_presentation_init(struct wayland_window *window)
+{
+	wl_list_init(&window->presentation_feedbacks);
+}
+
+void
+wayland_window_presentation_fini(struct wayland_window *window)
+{
+	struct presentation_feedback *feedback, *tmp;
+
+	wl_list_for_each_safe(feedback, tmp,
+			      &window->presentation_feedbacks, link) {
+		wp_presentation_feedback_destroy(feedback->feedback);
+		wl_list_remove(&feedback->link);
+		free(feedback);
+	}
+}
+
+/* ask for the feedback of the frame about to be committed, numbered by
+ * window->frame_count */
+void
+wayland_window_request_presentation(struct wayland_display *display,
+				    struct wayland_window *window)
+{
+	struct presentation_feedback *feedback;
+
+	if (!display->wp_presentation)
+		return;
+
+	feedback = malloc(sizeof (*feedback));
+	if (!feedback)
+		return;
+
+	feedback->window = window;
+	feedback->frame = window->frame_count;
+	feedback->swap_ns = get_presentation_time(display);
+	feedback->clock_id = display->presentation_clock;
+	feedback->feedback =
+		wp_presentation_feedback(display->wp_presentation,
+					 window->egl_window->surface);
+	wp_presentation_feedback_add_listener(feedback->feedback,
+					      &feedback_listener, feedback);
+	wl_proxy_set_queue((struct wl_proxy *) feedback->feedback,
+			   window->wl_queue);
+	wl_list_insert(&window->presentation_feedbacks, &feedback->link);
+}
+
+/* With a swap interval of N, the frame following the last committed one
+ * must reach the compositor after the (N-1)th vblank following its
+ * presentation. Compute a time a quarter of a refresh past that vblank,
+ * in the presentation clock. Called when the frame callback of the last
+ * frame fires; when its presentation is not known yet, that is taken as
+ * its presentation time, with the last refresh period reported or 60Hz
+ * otherwise. */
+uint64_t
+wayland_window_presentation_deadline(struct wayland_display *display,
+				     struct wayland_window *window,
+				     int interval)
+{
+	const struct wl_egl_presentation *presentation =
+		&window->egl_window->presentation;
+	uint64_t refresh_ns = presentation->refresh_ns;
+	uint64_t present_ns;
+
+	if (!refresh_ns)
+		refresh_ns = DEFAULT_REFRESH_NS;
+
+	if (presentation->frame == window->frame_count &&
+	    !presentation->discarded && presentation->refresh_ns)
+		present_ns = presentation->present_ns;
+	else
+		present_ns = get_presentation_time(display);
+
+	return present_ns + (interval - 1) * refresh_ns + refresh_ns / 4;
+}
+
+static int
+sleep_until(clockid_t clock_id, uint64_t deadline)
+{
+	struct timespec ts;
+	int ret;
+
+	ts.tv_sec = deadline / 1000000000ull;
+	ts.tv_nsec = deadline % 1000000000ull;
+
+	do {
+		ret = clock_nanosleep(clock_id, TIMER_ABSTIME, &ts, NULL);
+	} while (ret == EINTR);
+
+	return ret;
+}
+
+void
+wayland_presentation_sleep(struct wayland_display *display, uint64_t deadline)
+{
+	uint64_t now;
+
+	if (sleep_until(display->presentation_clock, deadline) != EINVAL)
+		return;
+
+	/* clocks like CLOCK_MONOTONIC_RAW cannot be slept on with older
+	 * kernels, sleep for the same time on CLOCK_MONOTONIC */
+	now = get_presentation_time(display);
+	if (deadline > now)
+		sleep_until(CLOCK_MONOTONIC, get_time_ns() + deadline - now);
+}
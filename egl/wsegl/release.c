@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "wayland-wsegl.h"
+
+/* time a render thread sleeps before checking the connection again */
+#define RELEASE_WAIT_TIMEOUT_MS	100
+
+static int
+futex_wait(int *addr, int val, int timeout_ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+	return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static void
+futex_wake_all(int *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+}
+
+static void *
+release_thread(void *data)
+{
+	struct wayland_display *display = data;
+	struct wayland_release_thread *release = &display->release;
+	struct pollfd pfd[2];
+	int ret;
+
+	pfd[0].fd = wl_display_get_fd(display->wl_display);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = release->wake_fd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		while (wl_display_prepare_read_queue(display->wl_display,
+						     release->queue) != 0) {
+			pthread_mutex_lock(&release->dispatch_lock);
+			wl_display_dispatch_queue_pending(display->wl_display,
+							  release->queue);
+			pthread_mutex_unlock(&release->dispatch_lock);
+		}
+
+		wl_display_flush(display->wl_display);
+
+		ret = poll(pfd, 2, -1);
+		if (ret < 0 || pfd[1].revents) {
+			wl_display_cancel_read(display->wl_display);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			if (wl_display_read_events(display->wl_display) < 0)
+				break;
+		} else {
+			wl_display_cancel_read(display->wl_display);
+		}
+
+		if (pfd[0].revents & (POLLERR | POLLHUP))
+			break;
+
+		pthread_mutex_lock(&release->dispatch_lock);
+		wl_display_dispatch_queue_pending(display->wl_display,
+						  release->queue);
+		pthread_mutex_unlock(&release->dispatch_lock);
+	}
+
+	dbg("release thread exiting");
+
+	/* wake up the waiters so they notice */
+	__atomic_store_n(&release->running, false, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&release->seq, 1, __ATOMIC_RELEASE);
+	futex_wake_all(&release->seq);
+
+	return NULL;
+}
+
+/* with EGL_RELEASE_THREAD set, buffer releases are read from the socket
+ * and dispatched by a helper thread, render threads only check the
+ * buffer locks and sleep on release->seq when none is free */
+void
+wayland_release_thread_start(struct wayland_display *display)
+{
+	struct wayland_release_thread *release = &display->release;
+
+	if (!debug_get_bool_option("EGL_RELEASE_THREAD", false))
+		return;
+
+	release->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (release->wake_fd < 0) {
+		err("failed to create release thread eventfd: %s",
+		    strerror(errno));
+		return;
+	}
+
+	pthread_mutex_init(&release->dispatch_lock, NULL);
+	release->queue = wl_display_create_queue(display->wl_display);
+	release->running = true;
+
+	if (pthread_create(&release->thread, NULL, release_thread, display)) {
+		err("failed to start release thread");
+		wl_event_queue_destroy(release->queue);
+		release->queue = NULL;
+		release->running = false;
+		close(release->wake_fd);
+		return;
+	}
+
+	dbg("release thread started");
+}
+
+/* stop the thread, its queue stays until the buffers are destroyed */
+void
+wayland_release_thread_stop(struct wayland_display *display)
+{
+	struct wayland_release_thread *release = &display->release;
+	uint64_t one = 1;
+
+	if (!release->queue)
+		return;
+
+	if (write(release->wake_fd, &one, sizeof (one)) != sizeof (one))
+		err("failed to wake up release thread");
+
+	pthread_join(release->thread, NULL);
+	close(release->wake_fd);
+}
+
+int
+wayland_release_seq(struct wayland_display *display)
+{
+	return __atomic_load_n(&display->release.seq, __ATOMIC_ACQUIRE);
+}
+
+/* called from the thread dispatching the release of buffer */
+void
+wayland_release_notify(struct wayland_display *display)
+{
+	struct wayland_release_thread *release = &display->release;
+
+	if (!release->queue)
+		return;
+
+	__atomic_add_fetch(&release->seq, 1, __ATOMIC_RELEASE);
+	futex_wake_all(&release->seq);
+}
+
+/* keep the release thread out of event handlers, so that an object it
+ * dispatches events for can be destroyed along with the handler data */
+void
+wayland_release_lock(struct wayland_display *display)
+{
+	if (display->release.queue)
+		pthread_mutex_lock(&display->release.dispatch_lock);
+}
+
+void
+wayland_release_unlock(struct wayland_display *display)
+{
+	if (display->release.queue)
+		pthread_mutex_unlock(&display->release.dispatch_lock);
+}
+
+/* wait for a release after the one numbered seq; returns -1 once the
+ * thread stopped dispatching, there will be no more releases then */
+int
+wayland_release_wait(struct wayland_display *display, int seq)
+{
+	struct wayland_release_thread *release = &display->release;
+
+	if (!__atomic_load_n(&release->running, __ATOMIC_ACQUIRE))
+		return -1;
+
+	if (futex_wait(&release->seq, seq, RELEASE_WAIT_TIMEOUT_MS) < 0 &&
+	    errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "wayland-wsegl.h"
+
+#ifndef MFD_CLOEXEC
+# define MFD_CLOEXEC		0x0001U
+# define MFD_ALLOW_SEALING	0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+# define F_ADD_SEALS		(1024 + 9)
+# define F_SEAL_SEAL		0x0001
+# define F_SEAL_SHRINK		0x0002
+#endif
+
+#ifndef FALLOC_FL_KEEP_SIZE
+# define FALLOC_FL_KEEP_SIZE	0x01
+# define FALLOC_FL_PUNCH_HOLE	0x02
+#endif
+
+struct shm_range {
+	size_t offset;
+	size_t size;
+};
+
+int
+wayland_create_anonymous_file(void)
+{
+	char filename[] = "/tmp/wayland-shm-XXXXXX";
+	int fd = -1;
+
+#ifdef __NR_memfd_create
+	fd = syscall(__NR_memfd_create, "wayland-shm",
+		     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0)
+		return fd;
+#endif
+
+	/* kernels older than 3.17 have no memfd */
+	fd = mkstemp(filename);
+	if (fd < 0)
+		return -1;
+
+	unlink(filename);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	return fd;
+}
+
+static size_t
+page_align(size_t size)
+{
+	size_t page_size = getpagesize();
+
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static void
+pool_add_free_range(struct wayland_shm_pool *pool, size_t offset, size_t size)
+{
+	struct shm_range *ranges, *range;
+	size_t count, i;
+
+	ranges = pool->free_ranges.data;
+	count = pool->free_ranges.size / sizeof (*ranges);
+
+	/* ranges are kept sorted by offset and coalesced */
+	for (i = 0; i < count && ranges[i].offset < offset; i++)
+		;
+
+	if (i > 0 && ranges[i - 1].offset + ranges[i - 1].size == offset) {
+		ranges[i - 1].size += size;
+
+		if (i < count && offset + size == ranges[i].offset) {
+			ranges[i - 1].size += ranges[i].size;
+			memmove(&ranges[i], &ranges[i + 1],
+				(count - i - 1) * sizeof (*ranges));
+			pool->free_ranges.size -= sizeof (*ranges);
+		}
+		return;
+	}
+
+	if (i < count && offset + size == ranges[i].offset) {
+		ranges[i].offset = offset;
+		ranges[i].size += size;
+		return;
+	}
+
+	if (!wl_array_add(&pool->free_ranges, sizeof (*range)))
+		return;
+
+	ranges = pool->free_ranges.data;
+	memmove(&ranges[i + 1], &ranges[i], (count - i) * sizeof (*ranges));
+	ranges[i].offset = offset;
+	ranges[i].size = size;
+}
+
+static bool
+pool_grow(struct wayland_shm_pool *pool, size_t size)
+{
+	if (size <= pool->size)
+		return true;
+
+	if (ftruncate(pool->fd, size) < 0) {
+		dbg("failed to grow SHM pool to %zu bytes: %m", size);
+		return false;
+	}
+
+	dbg("grow SHM pool from %zu to %zu bytes", pool->size, size);
+
+	wl_shm_pool_resize(pool->wl_pool, size);
+	pool_add_free_range(pool, pool->size, size - pool->size);
+	pool->size = size;
+
+	return true;
+}
+
+struct wayland_shm_pool *
+wayland_shm_pool_create(struct wayland_display *display, size_t size)
+{
+	struct wayland_shm_pool *pool;
+
+	pool = calloc(1, sizeof (*pool));
+	if (!pool)
+		return NULL;
+
+	size = page_align(size);
+	if (size == 0)
+		size = getpagesize();
+
+	pool->fd = wayland_create_anonymous_file();
+	if (pool->fd < 0) {
+		dbg("failed to create file for SHM pool: %m");
+		free(pool);
+		return NULL;
+	}
+
+	if (ftruncate(pool->fd, size) < 0) {
+		dbg("failed to allocate %zu bytes for SHM pool: %m", size);
+		close(pool->fd);
+		free(pool);
+		return NULL;
+	}
+
+	/* the compositor maps the whole pool, never let it shrink */
+	fcntl(pool->fd, F_ADD_SEALS, F_SEAL_SHRINK);
+
+	pool->wl_pool = wl_shm_create_pool(display->wl_shm, pool->fd, size);
+	if (!pool->wl_pool) {
+		close(pool->fd);
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	wl_array_init(&pool->free_ranges);
+	pool_add_free_range(pool, 0, size);
+	pool->size = size;
+	pool->refcount = 1;
+
+	return pool;
+}
+
+struct wayland_shm_pool *
+wayland_shm_pool_ref(struct wayland_shm_pool *pool)
+{
+	__sync_add_and_fetch(&pool->refcount, 1);
+
+	return pool;
+}
+
+void
+wayland_shm_pool_unref(struct wayland_shm_pool *pool)
+{
+	if (!pool || __sync_sub_and_fetch(&pool->refcount, 1) > 0)
+		return;
+
+	wl_shm_pool_destroy(pool->wl_pool);
+	wl_array_release(&pool->free_ranges);
+	pthread_mutex_destroy(&pool->lock);
+	close(pool->fd);
+	free(pool);
+}
+
+/* carve a page aligned range out of the pool, growing it if needed;
+ * returns the offset of the range or -1 on failure */
+long
+wayland_shm_pool_alloc(struct wayland_shm_pool *pool, size_t size)
+{
+	struct shm_range *ranges;
+	size_t count, i;
+	long offset = -1;
+
+	size = page_align(size);
+
+	pthread_mutex_lock(&pool->lock);
+
+	ranges = pool->free_ranges.data;
+	count = pool->free_ranges.size / sizeof (*ranges);
+
+	for (i = 0; i < count; i++) {
+		if (ranges[i].size >= size)
+			break;
+	}
+
+	if (i == count) {
+		size_t grow = size;
+
+		/* extend the free range at the end of the pool, if any */
+		if (count > 0 &&
+		    ranges[count - 1].offset + ranges[count - 1].size ==
+		    pool->size)
+			grow -= ranges[count - 1].size;
+
+		if (!pool_grow(pool, pool->size + grow))
+			goto out;
+
+		ranges = pool->free_ranges.data;
+		count = pool->free_ranges.size / sizeof (*ranges);
+		i = count - 1;
+	}
+
+	offset = ranges[i].offset;
+
+	if (ranges[i].size == size) {
+		memmove(&ranges[i], &ranges[i + 1],
+			(count - i - 1) * sizeof (*ranges));
+		pool->free_ranges.size -= sizeof (*ranges);
+	} else {
+		ranges[i].offset += size;
+		ranges[i].size -= size;
+	}
+
+out:
+	pthread_mutex_unlock(&pool->lock);
+
+	return offset;
+}
+
+void
+wayland_shm_pool_free(struct wayland_shm_pool *pool,
+		      size_t offset, size_t size)
+{
+	size = page_align(size);
+
+	pthread_mutex_lock(&pool->lock);
+
+	/* give the pages back to the system, the pool size is sealed */
+	fallocate(pool->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		  offset, size);
+
+	pool_add_free_range(pool, offset, size);
+
+	pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "wayland-wsegl.h"
+
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static bool stats_enabled;
+
+static void
+dump_latency(const char *name, const struct wl_egl_latency_stats *stats)
+{
+	if (stats->count == 0)
+		return;
+
+	err("  %s: %llu waits, avg %llu us, max %llu us", name,
+	    (unsigned long long) stats->count,
+	    (unsigned long long) (stats->total_ns / stats->count / 1000),
+	    (unsigned long long) (stats->max_ns / 1000));
+
+	for (int i = 0; i < WL_EGL_LATENCY_BUCKETS; i++) {
+		if (!stats->histogram[i])
+			continue;
+
+		err("    >= %10llu ns: %llu", 1ull << i,
+		    (unsigned long long) stats->histogram[i]);
+	}
+}
+
+static void
+dump_window(struct wayland_window *window)
+{
+	const struct wl_egl_frame_stats *stats =
+		&window->egl_window->frame_stats;
+
+	err("window %p: %llu swaps (%.1f/s), %llu buffers allocated",
+	    window->egl_window, (unsigned long long) stats->swaps,
+	    stats->swaps_per_second,
+	    (unsigned long long) stats->buffers_allocated);
+
+	dump_latency("gpu wait", &stats->gpu_wait);
+	dump_latency("throttle wait", &stats->throttle_wait);
+	dump_latency("buffer wait", &stats->buffer_wait);
+}
+
+static void
+stats_setup(void)
+{
+	stats_enabled = debug_get_bool_option("EGL_FRAME_STATS", false);
+}
+
+void
+wayland_window_stats_init(struct wayland_window *window)
+{
+	memset(&window->egl_window->frame_stats, 0,
+	       sizeof (window->egl_window->frame_stats));
+	window->rate_start = get_time_ns();
+	window->rate_swaps = 0;
+
+	pthread_once(&stats_once, stats_setup);
+}
+
+/* the window is still alive here, unlike at exit */
+void
+wayland_window_stats_fini(struct wayland_window *window)
+{
+	if (stats_enabled)
+		dump_window(window);
+}
+
+void
+wayland_window_stats_swap(struct wayland_window *window)
+{
+	struct wl_egl_frame_stats *stats = &window->egl_window->frame_stats;
+	uint64_t now = get_time_ns();
+
+	stats->swaps++;
+	window->rate_swaps++;
+
+	if (now - window->rate_start >= 1000000000ull) {
+		stats->swaps_per_second = window->rate_swaps * 1e9 /
+			(now - window->rate_start);
+		window->rate_start = now;
+		window->rate_swaps = 0;
+	}
+}
+
+/* account a wait that started at the given time and ends now */
+void
+wayland_latency_add(struct wl_egl_latency_stats *stats, uint64_t start)
+{
+	uint64_t ns = get_time_ns() - start;
+	int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+
+	if (bucket >= WL_EGL_LATENCY_BUCKETS)
+		bucket = WL_EGL_LATENCY_BUCKETS - 1;
+
+	stats->count++;
+	stats->total_ns += ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+	stats->histogram[bucket]++;
+}
@@ -0,0 +1,365 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "wayland-wsegl.h"
+
+#ifndef F_ADD_SEALS
+# define F_ADD_SEALS		(1024 + 9)
+# define F_SEAL_SEAL		0x0001
+# define F_SEAL_SHRINK		0x0002
+#endif
+
+/* time a render thread sleeps before checking the connection again */
+#define RELEASE_POINT_TIMEOUT_MS	100
+
+/* interval the GPU is polled at while rendering is in progress */
+#define FENCE_POLL_US			500
+
+struct wayland_fence {
+	PVR2DMEMINFO *meminfo;
+	struct wayland_timeline *timeline;
+	uint64_t point;
+	struct wl_list link;
+};
+
+struct wayland_timeline *
+wayland_timeline_create(struct wayland_display *display)
+{
+	struct wayland_timeline *timeline;
+	void *page;
+	int fd;
+
+	fd = wayland_create_anonymous_file();
+	if (fd < 0)
+		return NULL;
+
+	/* the compositor refuses timelines that could shrink under it,
+	 * which needs a memfd */
+	if (ftruncate(fd, sizeof (struct wl_gdl_timeline_page)) < 0 ||
+	    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	page = mmap(NULL, sizeof (struct wl_gdl_timeline_page),
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	timeline = calloc(1, sizeof (*timeline));
+	if (!timeline) {
+		munmap(page, sizeof (struct wl_gdl_timeline_page));
+		close(fd);
+		return NULL;
+	}
+
+	timeline->refcount = 1;
+	timeline->page = page;
+	timeline->wl_timeline =
+		wl_gdl_explicit_sync_create_timeline(display->wl_gdl_sync, fd);
+
+	/* the request carries its own copy of the fd */
+	close(fd);
+
+	return timeline;
+}
+
+struct wayland_timeline *
+wayland_timeline_ref(struct wayland_timeline *timeline)
+{
+	__atomic_add_fetch(&timeline->refcount, 1, __ATOMIC_RELAXED);
+	return timeline;
+}
+
+void
+wayland_timeline_unref(struct wayland_timeline *timeline)
+{
+	if (!timeline ||
+	    __atomic_sub_fetch(&timeline->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	wl_gdl_timeline_destroy(timeline->wl_timeline);
+	munmap(timeline->page, sizeof (struct wl_gdl_timeline_page));
+	free(timeline);
+}
+
+/* wait for the rendering to meminfo to complete; the lock is only held
+ * while polling, so other PVR2D users are not stalled meanwhile */
+static void
+wait_blits_complete(struct wayland_display *display, PVR2DMEMINFO *meminfo)
+{
+	PVR2DERROR pvr2d_rc;
+
+	for (;;) {
+		pthread_mutex_lock(&display->pvr2d_lock);
+		pvr2d_rc = PVR2DQueryBlitsComplete(display->pvr2d_context,
+						   meminfo, 0);
+		pthread_mutex_unlock(&display->pvr2d_lock);
+
+		if (pvr2d_rc != PVR2DERROR_BLT_NOTCOMPLETE)
+			break;
+
+		usleep(FENCE_POLL_US);
+	}
+
+	if (pvr2d_rc != PVR2D_OK)
+		dbg("failed to wait for rendering to complete");
+}
+
+/* signals the acquire points once the GPU is done with the buffers, so
+ * that swaps do not wait for the rendering to complete */
+static void *
+fence_thread(void *data)
+{
+	struct wayland_display *display = data;
+	struct wayland_fence_queue *queue = &display->fences;
+	struct wayland_fence *fence;
+
+	pthread_mutex_lock(&queue->lock);
+
+	for (;;) {
+		while (wl_list_empty(&queue->fences) && !queue->stop)
+			pthread_cond_wait(&queue->cond, &queue->lock);
+
+		if (wl_list_empty(&queue->fences))
+			break;
+
+		fence = wl_container_of(queue->fences.next, fence, link);
+		wl_list_remove(&fence->link);
+		queue->current = fence->meminfo;
+
+		pthread_mutex_unlock(&queue->lock);
+
+		wait_blits_complete(display, fence->meminfo);
+
+		wl_gdl_timeline_signal(fence->timeline->page, fence->point);
+		free(fence);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->current = NULL;
+		pthread_cond_broadcast(&queue->cond);
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+void
+wayland_fence_init(struct wayland_display *display)
+{
+	struct wayland_fence_queue *queue = &display->fences;
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+	wl_list_init(&queue->fences);
+}
+
+void
+wayland_fence_fini(struct wayland_display *display)
+{
+	struct wayland_fence_queue *queue = &display->fences;
+
+	if (queue->running) {
+		pthread_mutex_lock(&queue->lock);
+		queue->stop = true;
+		pthread_cond_broadcast(&queue->cond);
+		pthread_mutex_unlock(&queue->lock);
+
+		pthread_join(queue->thread, NULL);
+	}
+
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->lock);
+}
+
+/* signal the point once rendering to meminfo completes */
+static void
+fence_submit(struct wayland_display *display, PVR2DMEMINFO *meminfo,
+	     struct wayland_timeline *timeline, uint64_t point)
+{
+	struct wayland_fence_queue *queue = &display->fences;
+	struct wayland_fence *fence;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if (!queue->running) {
+		queue->running = !pthread_create(&queue->thread, NULL,
+						 fence_thread, display);
+		if (!queue->running)
+			err("failed to start fence thread");
+	}
+
+	fence = queue->running ? malloc(sizeof (*fence)) : NULL;
+	if (fence) {
+		fence->meminfo = meminfo;
+		fence->timeline = timeline;
+		fence->point = point;
+		wl_list_insert(queue->fences.prev, &fence->link);
+		pthread_cond_signal(&queue->cond);
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	if (fence)
+		return;
+
+	/* no thread to hand it over to, wait here */
+	wait_blits_complete(display, meminfo);
+
+	wl_gdl_timeline_signal(timeline->page, point);
+}
+
+/* wait until all submitted points are signaled */
+void
+wayland_fence_flush(struct wayland_display *display)
+{
+	struct wayland_fence_queue *queue = &display->fences;
+
+	pthread_mutex_lock(&queue->lock);
+	while (!wl_list_empty(&queue->fences) || queue->current)
+		pthread_cond_wait(&queue->cond, &queue->lock);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+static bool
+fence_queue_uses(struct wayland_fence_queue *queue, PVR2DMEMINFO *meminfo)
+{
+	struct wayland_fence *fence;
+
+	if (queue->current == meminfo)
+		return true;
+
+	wl_list_for_each(fence, &queue->fences, link)
+		if (fence->meminfo == meminfo)
+			return true;
+
+	return false;
+}
+
+/* wait until the points waiting on meminfo are signaled */
+void
+wayland_fence_flush_meminfo(struct wayland_display *display,
+			    PVR2DMEMINFO *meminfo)
+{
+	struct wayland_fence_queue *queue = &display->fences;
+
+	pthread_mutex_lock(&queue->lock);
+	while (fence_queue_uses(queue, meminfo))
+		pthread_cond_wait(&queue->cond, &queue->lock);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+bool
+wayland_window_sync_init(struct wayland_display *display,
+			 struct wayland_window *window)
+{
+	if (!display->wl_gdl_sync)
+		return true;
+
+	/* without a timeline the swap waits for the rendering instead */
+	window->acquire_timeline = wayland_timeline_create(display);
+	if (!window->acquire_timeline)
+		dbg("failed to create timeline, not using explicit sync");
+
+	return true;
+}
+
+void
+wayland_window_sync_fini(struct wayland_display *display,
+			 struct wayland_window *window)
+{
+	if (!window->acquire_timeline)
+		return;
+
+	/* the fence thread may still signal the acquire timeline */
+	wayland_fence_flush(display);
+
+	wayland_timeline_unref(window->acquire_timeline);
+}
+
+/* attach the next acquire point of the window and release point of the
+ * buffer to the buffer about to be committed, instead of waiting for its
+ * rendering to complete. Each buffer has its own release timeline since
+ * the compositor may release buffers out of order, e.g. when one is
+ * still scanned out. */
+bool
+wayland_window_sync_buffer(struct wayland_display *display,
+			   struct wayland_window *window,
+			   struct wayland_buffer *buffer)
+{
+	uint64_t acquire, release;
+
+	if (!buffer->release_timeline) {
+		buffer->release_timeline = wayland_timeline_create(display);
+		if (!buffer->release_timeline)
+			return false;
+	}
+
+	acquire = ++window->acquire_timeline->point;
+	release = ++buffer->release_timeline->point;
+
+	fence_submit(display, buffer->meminfo,
+		     window->acquire_timeline, acquire);
+
+	buffer->release_point = release;
+
+	wl_gdl_explicit_sync_set_buffer_sync(display->wl_gdl_sync,
+					     buffer->wl_buffer,
+					     window->acquire_timeline->wl_timeline,
+					     acquire >> 32, acquire & 0xffffffff,
+					     buffer->release_timeline->wl_timeline,
+					     release >> 32, release & 0xffffffff);
+
+	return true;
+}
+
+/* sleep until the compositor releases the oldest locked buffer of the
+ * window, or for a short while; false if no buffer waits on a point */
+bool
+wayland_window_wait_release(struct wayland_window *window)
+{
+	struct wayland_buffer *oldest = NULL;
+
+	for (int i = 0; i < window->num_buffers; i++) {
+		struct wayland_buffer *buffer = window->bufferpool[i];
+
+		if (!buffer->release_point || !wayland_buffer_is_locked(buffer))
+			continue;
+
+		if (!oldest || buffer->frame < oldest->frame)
+			oldest = buffer;
+	}
+
+	if (!oldest)
+		return false;
+
+	wl_gdl_timeline_wait(oldest->release_timeline->page,
+			     oldest->release_point, RELEASE_POINT_TIMEOUT_MS);
+
+	return true;
+}
+
+/* whether the compositor still uses the buffer; a signaled release point
+ * unlocks it without waiting for any event. The timeline stays with the
+ * buffer until it is destroyed, so this is safe from any thread. */
+bool
+wayland_buffer_is_locked(struct wayland_buffer *buffer)
+{
+	if (!__atomic_load_n(&buffer->lock, __ATOMIC_ACQUIRE))
+		return false;
+
+	if (!buffer->release_point ||
+	    !wl_gdl_timeline_is_signaled(buffer->release_timeline->page,
+					 buffer->release_point))
+		return true;
+
+	__atomic_store_n(&buffer->lock, false, __ATOMIC_RELEASE);
+
+	return false;
+}
@@ -13,6 +13,14 @@ get_time_ms(void)
 	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 bool
 debug_get_bool_option(const char *name, bool dfault)
 {
@@ -37,6 +45,23 @@ debug_get_bool_option(const char *name, bool dfault)
 	return result;
 }
 
+long
+debug_get_num_option(const char *name, long dfault)
+{
+	const char *str = getenv(name);
+	char *end;
+	long result;
+
+	if (str == NULL)
+		return dfault;
+
+	result = strtol(str, &end, 0);
+	if (end == str || *end != '\0')
+		return dfault;
+
+	return result;
+}
+
 const char *
 pvr2d_strerror(PVR2DERROR err)
 {
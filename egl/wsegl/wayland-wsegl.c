@@ -2,22 +2,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/mman.h>
 
 #include <EGL/egl.h>
 
 #include "wayland-wsegl.h"
+#include "pixmap.h"
 
+/* used when the compositor does not advertise its formats, and for the
+ * pixmap configs of the formats it does not take */
 static WSEGLConfig display_configs[] = {
-	{ WSEGL_DRAWABLE_WINDOW,
+	{ WSEGL_DRAWABLE_WINDOW | WSEGL_DRAWABLE_PIXMAP,
 	  WSEGL_PIXELFORMAT_XRGB8888, WSEGL_FALSE, 0,
 	  0, NULL, WSEGL_OPAQUE, 0 },
 
-	{ WSEGL_DRAWABLE_WINDOW,
+	{ WSEGL_DRAWABLE_WINDOW | WSEGL_DRAWABLE_PIXMAP,
 	  WSEGL_PIXELFORMAT_ARGB8888, WSEGL_FALSE, 0,
 	  0, NULL, WSEGL_OPAQUE, 0 },
 
-	{ WSEGL_DRAWABLE_WINDOW,
+	{ WSEGL_DRAWABLE_WINDOW | WSEGL_DRAWABLE_PIXMAP,
 	  WSEGL_PIXELFORMAT_RGB565, WSEGL_FALSE, 0,
 	  0, NULL, WSEGL_OPAQUE, 0 },
 
@@ -26,9 +30,10 @@ static WSEGLConfig display_configs[] = {
 
 static const WSEGLCaps display_caps[] = {
 	{ WSEGL_CAP_WINDOWS_USE_HW_SYNC, 1 },
+	{ WSEGL_CAP_PIXMAPS_USE_HW_SYNC, 1 },
 	{ WSEGL_CAP_UNLOCKED, 1 },
 	{ WSEGL_CAP_MIN_SWAP_INTERVAL, 0 },
-	{ WSEGL_CAP_MAX_SWAP_INTERVAL, 1 },
+	{ WSEGL_CAP_MAX_SWAP_INTERVAL, MAX_SWAP_INTERVAL },
 	{ WSEGL_NO_CAPS, 0 }
 };
 
@@ -87,11 +92,44 @@ wayland_roundtrip(struct wayland_display *display)
 	return ret;
 }
 
+/* flush requests, then read the events the compositor already sent and
+ * dispatch those of the given queue, without blocking; the read is
+ * coordinated with the other threads through prepare_read */
+int
+wayland_dispatch_pending(struct wayland_display *display,
+			 struct wl_event_queue *queue)
+{
+	struct pollfd pfd;
+
+	while (wl_display_prepare_read_queue(display->wl_display,
+					     queue) != 0) {
+		if (wl_display_dispatch_queue_pending(display->wl_display,
+						      queue) < 0)
+			return -1;
+	}
+
+	wl_display_flush(display->wl_display);
+
+	pfd.fd = wl_display_get_fd(display->wl_display);
+	pfd.events = POLLIN;
+
+	if (poll(&pfd, 1, 0) > 0) {
+		if (wl_display_read_events(display->wl_display) < 0)
+			return -1;
+	} else {
+		wl_display_cancel_read(display->wl_display);
+	}
+
+	return wl_display_dispatch_queue_pending(display->wl_display, queue);
+}
+
 static WSEGLError
 WSEGL_IsDisplayValid(NativeDisplayType native_display)
 {
+	/* headless, only when asked for */
 	if (native_display == EGL_DEFAULT_DISPLAY)
-		return WSEGL_BAD_NATIVE_DISPLAY;
+		return debug_get_bool_option("EGL_HEADLESS", false) ?
+			WSEGL_SUCCESS : WSEGL_BAD_NATIVE_DISPLAY;
 
 	if (pointer_is_dereferencable((void *) native_display)) {
 		void *ptr = *(void **) native_display;
@@ -114,21 +152,49 @@ WSEGL_CloseDisplay(WSEGLDisplayHandle display_handle)
 	if (!display)
 		return WSEGL_SUCCESS;
 
+	wl_egl_display_unregister(&display->egl_display);
+
+	wayland_idle_fini(display);
+
+	wayland_release_thread_stop(display);
+
+	wayland_buffer_cache_fini(display);
+
+	wayland_pixmap_fini(display);
+
+	wayland_fence_fini(display);
+
+	wayland_memory_fini(display);
+
+	wayland_headless_fini(display);
+
+	if (display->wl_gdl_sync)
+		wl_gdl_explicit_sync_destroy(display->wl_gdl_sync);
+
 	if (display->wl_gdl)
 		wl_gdl_destroy(display->wl_gdl);
 
 	if (display->wl_shm)
 		wl_shm_destroy(display->wl_shm);
 
+	if (display->wp_presentation)
+		wp_presentation_destroy(display->wp_presentation);
+
+	wl_array_release(&display->gdl_formats);
+
 	if (display->wl_queue)
 		wl_event_queue_destroy(display->wl_queue);
 
+	if (display->release.queue)
+		wl_event_queue_destroy(display->release.queue);
+
 	if (display->pvr2d_context)
 		PVR2DDestroyDeviceContext(display->pvr2d_context);
 
 	if (display->gdl_init)
 		gdl_close();
 
+	pthread_mutex_destroy(&display->pvr2d_lock);
 	free(display);
 
 	return WSEGL_SUCCESS;
@@ -139,6 +205,8 @@ struct wayland_globals {
 	uint32_t wl_gdl_version;
 	uint32_t wl_shm_id;
 	uint32_t wl_shm_version;
+	uint32_t wp_presentation_id;
+	uint32_t wl_gdl_sync_id;
 };
 
 static void
@@ -153,6 +221,10 @@ registry_handle_global(void *data, struct wl_registry *registry,
 	} else if (!strcmp(interface, "wl_shm")) {
 		globals->wl_shm_id = id;
 		globals->wl_shm_version = version;
+	} else if (!strcmp(interface, "wl_gdl_explicit_sync")) {
+		globals->wl_gdl_sync_id = id;
+	} else if (!strcmp(interface, "wp_presentation")) {
+		globals->wp_presentation_id = id;
 	}
 }
 
@@ -160,29 +232,133 @@ static const struct wl_registry_listener registry_listener = {
 	.global = registry_handle_global,
 };
 
+static void
+presentation_clock_id(void *data, struct wp_presentation *presentation,
+		      uint32_t clk_id)
+{
+	struct wayland_display *display = data;
+
+	display->presentation_clock = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+	.clock_id = presentation_clock_id,
+};
+
+static void
+gdl_format(void *data, struct wl_gdl *wl_gdl, uint32_t format, uint32_t flags)
+{
+	struct wayland_display *display = data;
+	const struct wayland_pixel_format *pf;
+	struct wayland_gdl_format *f;
+
+	pf = convert_gdl_pixel_format(format);
+	if (!pf || !pf->renderable)
+		return;
+
+	wl_array_for_each(f, &display->gdl_formats) {
+		if (f->format == pf) {
+			f->flags = flags;
+			return;
+		}
+	}
+
+	f = wl_array_add(&display->gdl_formats, sizeof (*f));
+	if (f) {
+		f->format = pf;
+		f->flags = flags;
+	}
+}
+
+static const struct wl_gdl_listener gdl_listener = {
+	.format = gdl_format,
+};
+
+static bool
+has_config(struct wayland_display *display, int n, WSEGLPixelFormat pf)
+{
+	for (int i = 0; i < n; i++)
+		if (display->configs[i].ePixelFormat == pf)
+			return true;
+
+	return false;
+}
+
+/* build the window configs from the advertised formats: the ones that
+ * can be scanned out come first, then those the compositor has to copy,
+ * each in the order of preference of the compositor. Rendering to a
+ * pixmap does not involve the compositor, so the other renderable
+ * formats follow as pixmap only configs. */
+static WSEGLConfig *
+build_configs(struct wayland_display *display)
+{
+	struct wayland_gdl_format *f;
+	WSEGLConfig *config;
+	int n = 0;
+
+	for (int scanout = 1; scanout >= 0; scanout--) {
+		wl_array_for_each(f, &display->gdl_formats) {
+			if (!!(f->flags & WL_GDL_FORMAT_FLAGS_SCANOUT) != scanout)
+				continue;
+
+			if (!scanout &&
+			    !(f->flags & WL_GDL_FORMAT_FLAGS_COMPOSITED))
+				continue;
+
+			if (n == CONFIG_MAX)
+				break;
+
+			dbg("config %d: %s%s", n, f->format->name,
+			    scanout ? " (scanout)" : "");
+
+			display->configs[n] = display_configs[0];
+			display->configs[n].ePixelFormat = f->format->wsegl_pf;
+			n++;
+		}
+	}
+
+	if (n == 0)
+		return display_configs;
+
+	for (config = display_configs;
+	     config->ui32DrawableType != WSEGL_NO_DRAWABLE && n < CONFIG_MAX;
+	     config++) {
+		if (has_config(display, n, config->ePixelFormat))
+			continue;
+
+		display->configs[n] = *config;
+		display->configs[n].ui32DrawableType = WSEGL_DRAWABLE_PIXMAP;
+		n++;
+	}
+
+	display->configs[n].ui32DrawableType = WSEGL_NO_DRAWABLE;
+
+	return display->configs;
+}
+
 static WSEGLError
-WSEGL_InitialiseDisplay(NativeDisplayType native_display,
-			WSEGLDisplayHandle *display_handle,
-			const WSEGLCaps **caps,
-			WSEGLConfig **configs)
+display_init_gdl(struct wayland_display *display)
+{
+	if (gdl_init(0) != GDL_SUCCESS) {
+		dbg("failed gdl init");
+		return WSEGL_CANNOT_INITIALISE;
+	}
+
+	display->gdl_init = true;
+
+	return WSEGL_SUCCESS;
+}
+
+/* bind the compositor globals buffers are shared through */
+static WSEGLError
+display_bind_globals(struct wayland_display *display)
 {
-	struct wayland_display *display;
 	struct wayland_globals globals;
 	struct wl_registry *registry;
 	bool use_sw;
-	PVR2DERROR pvr2d_rc;
-
-	dbg("initializing Wayland display");
 
 	use_sw = debug_get_bool_option("EGL_SOFTWARE", false);
 
-	display = calloc(1, sizeof (*display));
-	if (!display)
-		return WSEGL_OUT_OF_MEMORY;
-
-	display->wl_display = (struct wl_display *) native_display;
-	display->wl_queue = wl_display_create_queue(display->wl_display);
-
 	memset(&globals, 0, sizeof (globals));
 	registry = wl_display_get_registry(display->wl_display);
 	wl_proxy_set_queue((struct wl_proxy *) registry, display->wl_queue);
@@ -193,7 +369,7 @@ WSEGL_InitialiseDisplay(NativeDisplayType native_display,
 		use_sw = true;
 
 	if (use_sw && !globals.wl_shm_version) {
-		WSEGL_CloseDisplay(display);
+		wl_registry_destroy(registry);
 		return WSEGL_CANNOT_INITIALISE;
 	}
 
@@ -202,21 +378,104 @@ WSEGL_InitialiseDisplay(NativeDisplayType native_display,
 		display->wl_shm = wl_registry_bind(registry, globals.wl_shm_id,
 						   &wl_shm_interface, 1);
 	} else {
-		if (gdl_init(0) != GDL_SUCCESS) {
-			dbg("failed gdl init");
-			WSEGL_CloseDisplay(display);
+		if (display_init_gdl(display) != WSEGL_SUCCESS) {
+			wl_registry_destroy(registry);
 			return WSEGL_CANNOT_INITIALISE;
 		}
 
-		display->gdl_init = true;
-
 		dbg("allocating buffers using GDL");
+		if (globals.wl_gdl_version > 6)
+			globals.wl_gdl_version = 6;
+
 		display->wl_gdl = wl_registry_bind(registry, globals.wl_gdl_id,
-						   &wl_gdl_interface, 1);
+						   &wl_gdl_interface,
+						   globals.wl_gdl_version);
+		wl_gdl_add_listener(display->wl_gdl, &gdl_listener, display);
+
+		if (globals.wl_gdl_sync_id &&
+		    debug_get_bool_option("EGL_EXPLICIT_SYNC", true)) {
+			dbg("using explicit sync");
+			display->wl_gdl_sync =
+				wl_registry_bind(registry,
+						 globals.wl_gdl_sync_id,
+						 &wl_gdl_explicit_sync_interface,
+						 1);
+		}
 	}
 
+	if (globals.wp_presentation_id) {
+		display->wp_presentation =
+			wl_registry_bind(registry, globals.wp_presentation_id,
+					 &wp_presentation_interface, 1);
+		wp_presentation_add_listener(display->wp_presentation,
+					     &presentation_listener, display);
+	}
+
+	/* get the presentation clock and the formats before the first swap */
+	if (display->wp_presentation || (display->wl_gdl &&
+	    globals.wl_gdl_version >= WL_GDL_FORMAT_SINCE_VERSION))
+		wayland_roundtrip(display);
+
 	wl_registry_destroy(registry);
 
+	return WSEGL_SUCCESS;
+}
+
+/* with EGL_HEADLESS set, any display, EGL_DEFAULT_DISPLAY included,
+ * renders to GDL surfaces no compositor ever sees, see headless.c */
+static WSEGLError
+WSEGL_InitialiseDisplay(NativeDisplayType native_display,
+			WSEGLDisplayHandle *display_handle,
+			const WSEGLCaps **caps,
+			WSEGLConfig **configs)
+{
+	struct wayland_display *display;
+	PVR2DERROR pvr2d_rc;
+	WSEGLError err;
+	bool headless;
+
+	headless = debug_get_bool_option("EGL_HEADLESS", false);
+	if (native_display == EGL_DEFAULT_DISPLAY && !headless)
+		return WSEGL_BAD_NATIVE_DISPLAY;
+
+	display = calloc(1, sizeof (*display));
+	if (!display)
+		return WSEGL_OUT_OF_MEMORY;
+
+	display->headless.enabled = headless;
+
+	if (display->headless.enabled) {
+		/* frames never show up, make that obvious */
+		err("EGL_HEADLESS set, frames are not presented");
+	} else {
+		dbg("initializing Wayland display");
+		display->wl_display = (struct wl_display *) native_display;
+		display->wl_queue =
+			wl_display_create_queue(display->wl_display);
+	}
+
+	/* until the compositor tells its own */
+	display->presentation_clock = CLOCK_MONOTONIC;
+	pthread_mutex_init(&display->pvr2d_lock, NULL);
+	wl_array_init(&display->gdl_formats);
+
+	wayland_buffer_cache_init(display);
+	wayland_pixmap_init(display);
+	wayland_fence_init(display);
+	wayland_idle_init(display);
+	wayland_memory_init(display);
+	wayland_headless_init(display);
+
+	if (display->headless.enabled)
+		err = display_init_gdl(display);
+	else
+		err = display_bind_globals(display);
+
+	if (err != WSEGL_SUCCESS) {
+		WSEGL_CloseDisplay(display);
+		return err;
+	}
+
 	pvr2d_rc = PVR2DCreateDeviceContext(1, &display->pvr2d_context, 0);
 	if (pvr2d_rc != PVR2D_OK) {
 		dbg("failed to create pvr2d context: %s",
@@ -225,13 +484,82 @@ WSEGL_InitialiseDisplay(NativeDisplayType native_display,
 		return WSEGL_OUT_OF_MEMORY;
 	}
 
+	if (!display->headless.enabled)
+		wayland_release_thread_start(display);
+
+	/* the stats of a headless display are found by its native display,
+	 * NULL for EGL_DEFAULT_DISPLAY */
+	display->egl_display.display = (struct wl_display *) native_display;
+	display->egl_display.driver_private = display;
+	display->egl_display.get_buffer_cache_stats =
+		wayland_buffer_cache_get_stats;
+	display->egl_display.get_memory_stats = wayland_memory_get_stats;
+	wl_egl_display_register(&display->egl_display);
+
 	*caps = display_caps;
-	*configs = display_configs;
+	*configs = build_configs(display);
 	*display_handle = (WSEGLDisplayHandle) display;
 
 	return WSEGL_SUCCESS;
 }
 
+static void
+gdl_surface_bypass_state(void *data, struct wl_gdl_surface *gdl_surface,
+			 uint32_t active)
+{
+	struct wayland_drawable *drawable = data;
+
+	dbg("bypass %s", active ? "active" : "inactive");
+	__atomic_store_n(&drawable->window.egl_window->bypass_active, active,
+			 __ATOMIC_RELEASE);
+}
+
+static void
+gdl_surface_visibility(void *data, struct wl_gdl_surface *gdl_surface,
+		       uint32_t visible)
+{
+	struct wayland_drawable *drawable = data;
+
+	dbg("window %s", visible ? "visible" : "hidden");
+	__atomic_store_n(&drawable->window.visible, visible,
+			 __ATOMIC_RELEASE);
+
+	if (!visible)
+		wayland_idle_wake(drawable->display);
+}
+
+static const struct wl_gdl_surface_listener gdl_surface_listener = {
+	.bypass_state = gdl_surface_bypass_state,
+	.visibility = gdl_surface_visibility,
+};
+
+static bool
+window_get_gdl_surface(struct wayland_drawable *drawable)
+{
+	struct wayland_display *display = drawable->display;
+	struct wayland_window *window = &drawable->window;
+
+	if (window->gdl_surface)
+		return true;
+
+	if (!display->wl_gdl ||
+	    wl_proxy_get_version((struct wl_proxy *) display->wl_gdl) <
+	    WL_GDL_GET_SURFACE_SINCE_VERSION)
+		return false;
+
+	/* with a release thread, visibility changes are seen while the
+	 * window does not swap; the handlers only store flags */
+	window->gdl_surface = wl_gdl_get_surface(display->wl_gdl,
+						 window->egl_window->surface);
+	wl_proxy_set_queue((struct wl_proxy *) window->gdl_surface,
+			   display->release.queue ?
+			   display->release.queue : window->wl_queue);
+	wl_gdl_surface_add_listener(window->gdl_surface,
+				    &gdl_surface_listener, drawable);
+
+	return true;
+}
+
 static WSEGLError
 WSEGL_CreateWindowDrawable(WSEGLDisplayHandle display_handle,
 			   WSEGLConfig *config,
@@ -265,8 +593,10 @@ WSEGL_CreateWindowDrawable(WSEGLDisplayHandle display_handle,
 		return WSEGL_BAD_CONFIG;
 	}
 
+	/* headless windows need no surface */
 	egl_window = native_window;
-	if (!egl_window || !egl_window->surface) {
+	if (!egl_window ||
+	    (!egl_window->surface && !display->headless.enabled)) {
 		dbg("null native window handle");
 		return WSEGL_BAD_NATIVE_WINDOW;
 	}
@@ -282,10 +612,59 @@ WSEGL_CreateWindowDrawable(WSEGLDisplayHandle display_handle,
 	drawable->height = egl_window->height;
 
 	drawable->window.egl_window = egl_window;
+	if (display->wl_display) {
+		drawable->window.wl_queue =
+			wl_display_create_queue(display->wl_display);
+		if (!drawable->window.wl_queue) {
+			free(drawable);
+			return WSEGL_OUT_OF_MEMORY;
+		}
+	}
+
 	drawable->window.num_buffers = 0;
+	drawable->window.min_buffers = 2;
 	drawable->window.max_buffers = BUFFER_COUNT;
+	drawable->window.trim_frames =
+		debug_get_num_option("EGL_BUFFER_TRIM_FRAMES",
+				     BUFFER_TRIM_FRAMES);
 	drawable->window.swap_interval = 1;
 
+	if (!wayland_window_sync_init(display, &drawable->window)) {
+		if (drawable->window.wl_queue)
+			wl_event_queue_destroy(drawable->window.wl_queue);
+		free(drawable);
+		return WSEGL_OUT_OF_MEMORY;
+	}
+
+	wayland_window_stats_init(&drawable->window);
+	wayland_window_presentation_init(&drawable->window);
+
+	if (display->wl_shm) {
+		size_t size = wayland_shm_buffer_size(drawable->width,
+						      drawable->height,
+						      drawable->format);
+
+		drawable->window.shm_pool =
+			wayland_shm_pool_create(display, size * BUFFER_COUNT);
+		if (!drawable->window.shm_pool) {
+			wayland_window_stats_fini(&drawable->window);
+			wayland_window_sync_fini(display, &drawable->window);
+			wl_event_queue_destroy(drawable->window.wl_queue);
+			free(drawable);
+			return WSEGL_OUT_OF_MEMORY;
+		}
+	}
+
+	pthread_mutex_init(&drawable->window.lock, NULL);
+
+	/* the compositor tells hidden windows through wl_gdl_surface */
+	if (display->wl_gdl &&
+	    wl_proxy_get_version((struct wl_proxy *) display->wl_gdl) >=
+	    WL_GDL_SURFACE_VISIBILITY_SINCE_VERSION)
+		window_get_gdl_surface(drawable);
+
+	wayland_window_idle_init(display, &drawable->window);
+
 	*drawable_handle = (WSEGLDrawableHandle) drawable;
 	*rotation_angle = 0;
 
@@ -297,13 +676,40 @@ destroy_drawable_window(struct wayland_drawable *drawable)
 {
 	struct wayland_window *win = &drawable->window;
 
+	wayland_window_idle_fini(drawable->display, win);
+
+	/* events left in the window queue would be lost with it */
+	if (win->wl_queue)
+		wl_display_dispatch_queue_pending(drawable->display->wl_display,
+						  win->wl_queue);
+
+	wayland_window_sync_fini(drawable->display, win);
+
 	for (int i = 0; i < win->num_buffers; i++)
-		wayland_destroy_buffer(drawable->display, win->bufferpool[i]);
+		wayland_release_buffer(drawable->display, win->bufferpool[i]);
+
+	wayland_shm_pool_unref(win->shm_pool);
+	wayland_window_presentation_fini(win);
+	wayland_window_stats_fini(win);
 
 	if (win->throttle_cb)
 		wl_callback_destroy(win->throttle_cb);
+
+	/* the release thread may be running its handlers, and could
+	 * dispatch queued events until the proxy is gone */
+	if (win->gdl_surface) {
+		wayland_release_lock(drawable->display);
+		wl_gdl_surface_destroy(win->gdl_surface);
+		wayland_release_unlock(drawable->display);
+	}
+
+	if (win->wl_queue)
+		wl_event_queue_destroy(win->wl_queue);
+	pthread_mutex_destroy(&win->lock);
 }
 
+/* wrap a native pixmap, used both as EGL image source and as render
+ * target of a pixmap surface */
 static WSEGLError
 WSEGL_CreateImageDrawable(WSEGLDisplayHandle display_handle,
 			  WSEGLDrawableHandle *drawable_handle,
@@ -315,7 +721,8 @@ WSEGL_CreateImageDrawable(WSEGLDisplayHandle display_handle,
 	struct wayland_buffer *buffer;
 	WSEGLError err;
 
-	if (drawable_handle == NULL || !native_pixmap)
+	if (display_handle == NULL || drawable_handle == NULL ||
+	    !native_pixmap)
 		return WSEGL_BAD_NATIVE_PIXMAP;
 
 	drawable = calloc(1, sizeof (*drawable));
@@ -347,29 +754,13 @@ WSEGL_CreateImageDrawable(WSEGLDisplayHandle display_handle,
 	return WSEGL_SUCCESS;
 }
 
-static WSEGLError
-WSEGL_CreatePixmapDrawable(WSEGLDisplayHandle display_handle,
-			   WSEGLConfig *config,
-			   WSEGLDrawableHandle *drawable_handle,
-			   NativePixmapType native_pixmap,
-			   WSEGLRotationAngle *rotation_angle)
-{
-	if (config == NULL) {
-		// config is not set, we are creating an EGL image
-		return WSEGL_CreateImageDrawable(display_handle,
-						 drawable_handle,
-						 native_pixmap);
-	}
-
-	return WSEGL_BAD_NATIVE_PIXMAP;
-}
-
 static void
 destroy_drawable_pixmap(struct wayland_drawable *drawable)
 {
 	struct wayland_pixmap *pixmap = &drawable->pixmap;
 
 	wayland_unbind_buffer(drawable->display, pixmap->buffer);
+	free(pixmap->buffer);
 }
 
 static void
@@ -390,6 +781,53 @@ wayland_drawable_destroy(struct wayland_drawable *drawable)
 	free(drawable);
 }
 
+static WSEGLError
+WSEGL_CreatePixmapDrawable(WSEGLDisplayHandle display_handle,
+			   WSEGLConfig *config,
+			   WSEGLDrawableHandle *drawable_handle,
+			   NativePixmapType native_pixmap,
+			   WSEGLRotationAngle *rotation_angle)
+{
+	struct wayland_drawable *drawable;
+	const struct wayland_pixel_format *format;
+	WSEGLError err;
+
+	if (config == NULL) {
+		// config is not set, we are creating an EGL image
+		return WSEGL_CreateImageDrawable(display_handle,
+						 drawable_handle,
+						 native_pixmap);
+	}
+
+	if (!(config->ui32DrawableType & WSEGL_DRAWABLE_PIXMAP)) {
+		dbg("selected config does not support pixmap drawables");
+		return WSEGL_BAD_CONFIG;
+	}
+
+	err = WSEGL_CreateImageDrawable(display_handle, drawable_handle,
+					native_pixmap);
+	if (err != WSEGL_SUCCESS)
+		return err;
+
+	drawable = *drawable_handle;
+	format = drawable->format;
+
+	/* EGL renders in the config format, there is no conversion */
+	if (!format->renderable || format->wsegl_pf != config->ePixelFormat) {
+		dbg("pixmap format %s does not match config", format->name);
+		wayland_drawable_destroy(drawable);
+		*drawable_handle = NULL;
+		return WSEGL_BAD_MATCH;
+	}
+
+	dbg("render to %dx%d %s pixmap", drawable->width, drawable->height,
+	    format->name);
+
+	*rotation_angle = 0;
+
+	return WSEGL_SUCCESS;
+}
+
 static WSEGLError
 WSEGL_DeleteDrawable(WSEGLDrawableHandle drawable_handle)
 {
@@ -414,19 +852,189 @@ _swap_pointers(const void **p1, const void **p2)
 #define swap_pointers(p1, p2) \
 	_swap_pointers((const void **) p1, (const void **) p2)
 
+static const struct wl_callback_listener throttle_listener;
+
+static void
+window_request_frame(struct wayland_drawable *drawable)
+{
+	struct wayland_window *window = &drawable->window;
+	struct wl_callback *callback;
+
+	callback = wl_surface_frame(window->egl_window->surface);
+	wl_callback_add_listener(callback, &throttle_listener, drawable);
+	wl_proxy_set_queue((struct wl_proxy *) callback, window->wl_queue);
+	window->throttle_cb = callback;
+}
+
 static void
 throttle_callback(void *data, struct wl_callback *callback, uint32_t time)
 {
-	struct wayland_window *window = data;
+	struct wayland_drawable *drawable = data;
+	struct wayland_window *window = &drawable->window;
+	int interval = window->throttle_frames;
 
 	window->throttle_cb = NULL;
+	window->throttle_frames = 0;
 	wl_callback_destroy(callback);
+
+	/* the remaining intervals are counted from the presentation of the
+	 * frame, the next swap sleeps until then; committing from here to
+	 * get more callbacks would apply whatever state the application has
+	 * pending on the surface */
+	if (interval > 1)
+		window->throttle_deadline =
+			wayland_window_presentation_deadline(drawable->display,
+							     window, interval);
 }
 
 static const struct wl_callback_listener throttle_listener = {
 	throttle_callback
 };
 
+static void
+surface_damage(struct wl_surface *surface, int x, int y, int w, int h)
+{
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+	if (wl_proxy_get_version((struct wl_proxy *) surface) >=
+	    WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+		wl_surface_damage_buffer(surface, x, y, w, h);
+		return;
+	}
+#endif
+
+	/* without buffer scale or transform both spaces are the same */
+	wl_surface_damage(surface, x, y, w, h);
+}
+
+struct damage_box {
+	int x1, y1, x2, y2;
+};
+
+static bool
+damage_box_merge(struct damage_box *a, const struct damage_box *b)
+{
+	/* only merge boxes that overlap or touch, the union of disjoint
+	 * boxes would damage pixels that did not change */
+	if (a->x1 > b->x2 || b->x1 > a->x2 || a->y1 > b->y2 || b->y1 > a->y2)
+		return false;
+
+	if (b->x1 < a->x1)
+		a->x1 = b->x1;
+	if (b->y1 < a->y1)
+		a->y1 = b->y1;
+	if (b->x2 > a->x2)
+		a->x2 = b->x2;
+	if (b->y2 > a->y2)
+		a->y2 = b->y2;
+
+	return true;
+}
+
+/* send the damage set with wl_egl_window_set_damage for this frame, or
+ * damage the whole buffer */
+static void
+window_damage(struct wayland_window *window, struct wayland_buffer *buffer)
+{
+	struct wl_egl_window *egl_window = window->egl_window;
+	struct damage_box boxes[WL_EGL_WINDOW_MAX_DAMAGE_RECTS];
+	int n_boxes = 0;
+	bool merged;
+
+	for (int i = 0; i < egl_window->n_damage_rects; i++) {
+		const int *rect = &egl_window->damage_rects[i * 4];
+		struct damage_box *box = &boxes[n_boxes];
+
+		/* EGL rectangles have their origin at the bottom left */
+		box->x1 = rect[0];
+		box->x2 = rect[0] + rect[2];
+		box->y1 = buffer->height - (rect[1] + rect[3]);
+		box->y2 = buffer->height - rect[1];
+
+		if (box->x1 < 0)
+			box->x1 = 0;
+		if (box->y1 < 0)
+			box->y1 = 0;
+		if (box->x2 > buffer->width)
+			box->x2 = buffer->width;
+		if (box->y2 > buffer->height)
+			box->y2 = buffer->height;
+
+		if (box->x1 < box->x2 && box->y1 < box->y2)
+			n_boxes++;
+	}
+
+	egl_window->n_damage_rects = 0;
+
+	do {
+		merged = false;
+
+		for (int i = 0; i < n_boxes; i++) {
+			for (int j = i + 1; j < n_boxes; j++) {
+				if (!damage_box_merge(&boxes[i], &boxes[j]))
+					continue;
+
+				boxes[j--] = boxes[--n_boxes];
+				merged = true;
+			}
+		}
+	} while (merged);
+
+	if (n_boxes == 0 || n_boxes > DAMAGE_RECT_MAX) {
+		surface_damage(egl_window->surface, 0, 0,
+			       buffer->width, buffer->height);
+		return;
+	}
+
+	for (int i = 0; i < n_boxes; i++) {
+		surface_damage(egl_window->surface,
+			       boxes[i].x1, boxes[i].y1,
+			       boxes[i].x2 - boxes[i].x1,
+			       boxes[i].y2 - boxes[i].y1);
+	}
+}
+
+/* forward a change of the bypass hint of the window to the compositor */
+static void
+window_update_bypass(struct wayland_drawable *drawable)
+{
+	struct wayland_window *window = &drawable->window;
+	struct wl_egl_window *egl_window = window->egl_window;
+
+	if (egl_window->bypass_hint == window->bypass_hint)
+		return;
+
+	if (!window_get_gdl_surface(drawable))
+		return;
+
+	wl_gdl_surface_set_bypass(window->gdl_surface,
+				  egl_window->bypass_hint ?
+				  WL_GDL_SURFACE_BYPASS_PREFERRED :
+				  WL_GDL_SURFACE_BYPASS_NONE);
+	window->bypass_hint = egl_window->bypass_hint;
+}
+
+/* no compositor to wait for or to hand the buffer to, the swap interval
+ * is ignored so swaps run as fast as rendering */
+static void
+window_swap_headless(struct wayland_drawable *drawable,
+		     struct wayland_buffer *buffer)
+{
+	struct wayland_window *window = &drawable->window;
+
+	wayland_headless_present(drawable->display, window, buffer);
+
+	window->dx = 0;
+	window->dy = 0;
+	window->egl_window->n_damage_rects = 0;
+	buffer->frame = ++window->frame_count;
+
+	wayland_window_stats_swap(window);
+	window->last_swap_ns = get_time_ns();
+
+	swap_pointers(&window->buffers[BUFFER_ID_FRONT],
+		      &window->buffers[BUFFER_ID_BACK]);
+}
+
 static WSEGLError
 WSEGL_SwapDrawable(WSEGLDrawableHandle drawable_handle,
 		   unsigned long ui32Data)
@@ -436,66 +1044,116 @@ WSEGL_SwapDrawable(WSEGLDrawableHandle drawable_handle,
 	struct wayland_display *display;
 	struct wayland_window *window;
 	struct wayland_buffer *buffer;
-	struct wl_callback *callback;
+	struct wl_egl_frame_stats *stats;
 	PVR2DERROR pvr2d_rc;
+	uint64_t start;
+	bool throttled;
 
 	if (drawable->type != WSEGL_DRAWABLE_WINDOW)
 		return WSEGL_SUCCESS;
 
 	display = drawable->display;
 	window = &drawable->window;
+	stats = &window->egl_window->frame_stats;
+
+	pthread_mutex_lock(&window->lock);
 	buffer = window->buffers[BUFFER_ID_BACK];
 
-	pthread_mutex_lock(&display->pvr2d_lock);
-	pvr2d_rc = PVR2DQueryBlitsComplete(display->pvr2d_context,
-					   buffer->meminfo, 1);
-	pthread_mutex_unlock(&display->pvr2d_lock);
-	if (pvr2d_rc != PVR2D_OK)
-		dbg("failed to commit gfx queue");
+	if (display->headless.enabled) {
+		window_swap_headless(drawable, buffer);
+		pthread_mutex_unlock(&window->lock);
+		return WSEGL_SUCCESS;
+	}
+
+	/* with explicit sync the compositor waits for the rendering */
+	if (!window->acquire_timeline ||
+	    !wayland_window_sync_buffer(display, window, buffer)) {
+		buffer->release_point = 0;
+		start = get_time_ns();
+		pthread_mutex_lock(&display->pvr2d_lock);
+		pvr2d_rc = PVR2DQueryBlitsComplete(display->pvr2d_context,
+						   buffer->meminfo, 1);
+		pthread_mutex_unlock(&display->pvr2d_lock);
+		if (pvr2d_rc != PVR2D_OK)
+			dbg("failed to commit gfx queue");
+		wayland_latency_add(&stats->gpu_wait, start);
+	}
+
+	/* in mailbox mode the compositor replaces a pending frame by the
+	 * new one and releases it, never wait for the previous swap */
+	if (window->swap_interval == 0) {
+		if (window->throttle_cb)
+			wl_callback_destroy(window->throttle_cb);
+		window->throttle_cb = NULL;
+		window->throttle_deadline = 0;
+	}
+
+	throttled = window->throttle_cb || window->throttle_deadline;
+	if (throttled)
+		start = get_time_ns();
 
 	while (window->throttle_cb) {
 		int ret;
 
+		/* a hidden window can wait here for long, let the idle
+		 * thread free its spare buffers meanwhile */
+		pthread_mutex_unlock(&window->lock);
+
 		dbg("wait for swap to finish");
 		ret = wl_display_dispatch_queue(display->wl_display,
-						display->wl_queue);
+						window->wl_queue);
+
+		pthread_mutex_lock(&window->lock);
+
 		if (ret < 0) {
 			dbg("failed to wait for swap to finish");
+			pthread_mutex_unlock(&window->lock);
 			return WSEGL_SUCCESS;
 		}
 	}
 
+	if (window->throttle_deadline) {
+		wayland_presentation_sleep(display, window->throttle_deadline);
+		window->throttle_deadline = 0;
+	}
+
+	if (throttled)
+		wayland_latency_add(&stats->throttle_wait, start);
+
 	dbg("swap surface=%d w=%d(%d) h=%d format=%s", buffer->id,
 	    buffer->width, buffer->pitch, buffer->height,
 	    buffer->format->name);
 
 	wl_surface_attach(window->egl_window->surface,
-			  buffer->wl_buffer, 0, 0);
-	wl_surface_damage(window->egl_window->surface, 0, 0,
-			  buffer->width, buffer->height);
+			  buffer->wl_buffer, window->dx, window->dy);
+	window->dx = 0;
+	window->dy = 0;
+	window_damage(window, buffer);
 
 	if (window->swap_interval > 0) {
-		callback = wl_surface_frame(window->egl_window->surface);
-		wl_callback_add_listener(callback, &throttle_listener, window);
-		wl_proxy_set_queue((struct wl_proxy *) callback,
-				   display->wl_queue);
-		window->throttle_cb = callback;
+		window_request_frame(drawable);
+		window->throttle_frames = window->swap_interval;
 	}
 
+	__atomic_store_n(&buffer->lock, true, __ATOMIC_RELEASE);
+	buffer->frame = ++window->frame_count;
+
+	wayland_window_request_presentation(display, window);
+	window_update_bypass(drawable);
+
 	wl_surface_commit(window->egl_window->surface);
 
-	buffer->lock = 1;
+	wayland_window_stats_swap(window);
+	window->last_swap_ns = get_time_ns();
 
 	swap_pointers(&window->buffers[BUFFER_ID_FRONT],
 		      &window->buffers[BUFFER_ID_BACK]);
 
-	if (!window->throttle_cb) {
-		callback = wl_display_sync(display->wl_display);
-		wl_callback_add_listener(callback, &throttle_listener, window);
-		wl_proxy_set_queue((struct wl_proxy *) callback,
-				   display->wl_queue);
-		window->throttle_cb = callback;
-	}
+	/* nothing dispatches the queue until the next buffer is needed */
+	if (window->swap_interval == 0)
+		wl_display_flush(display->wl_display);
+
+	pthread_mutex_unlock(&window->lock);
 
 	return WSEGL_SUCCESS;
 }
@@ -512,6 +1170,9 @@ WSEGL_SwapControlInterval(WSEGLDrawableHandle drawable_handle,
 
 	dbg("set swap interval %lu", ui32Interval);
 
+	if (ui32Interval > MAX_SWAP_INTERVAL)
+		ui32Interval = MAX_SWAP_INTERVAL;
+
 	drawable->window.swap_interval = ui32Interval;
 
 	return WSEGL_SUCCESS;
@@ -521,12 +1182,24 @@ static WSEGLError
 WSEGL_WaitNative(WSEGLDrawableHandle drawable_handle,
 		 unsigned long ui32Engine)
 {
+	struct wayland_drawable *drawable =
+		(struct wayland_drawable *)drawable_handle;
+
 	if (drawable_handle == NULL)
 		return WSEGL_BAD_NATIVE_PIXMAP;
 
 	if (ui32Engine != WSEGL_DEFAULT_NATIVE_ENGINE)
 		return WSEGL_BAD_NATIVE_ENGINE;
 
+	/* pixmaps filled by eglCopyBuffers become usable natively; a pixmap
+	 * surface only has to wait for the copies to its own pixmap before
+	 * EGL renders to it */
+	if (drawable->type == WSEGL_DRAWABLE_PIXMAP)
+		wayland_wait_pixmap_copies(drawable->display,
+					   drawable->pixmap.buffer->pixmap);
+	else
+		wayland_wait_pixmap_copies(drawable->display, NULL);
+
 	return WSEGL_SUCCESS;
 }
 
@@ -534,15 +1207,31 @@ static WSEGLError
 WSEGL_CopyFromDrawable(WSEGLDrawableHandle drawable_handle,
 		       NativePixmapType native_pixmap)
 {
+	struct wayland_drawable *drawable =
+		(struct wayland_drawable *)drawable_handle;
+	struct wayland_buffer *buffer;
+
 	if (drawable_handle == NULL)
 		return WSEGL_BAD_DRAWABLE;
 
 	if (native_pixmap == NULL)
 		return WSEGL_BAD_NATIVE_PIXMAP;
 
-	//FIXME: implement this
+	if (drawable->type == WSEGL_DRAWABLE_WINDOW) {
+		struct wayland_window *window = &drawable->window;
 
-	return WSEGL_BAD_DRAWABLE;
+		buffer = window->buffers[BUFFER_ID_FRONT];
+		if (!buffer)
+			buffer = window->buffers[BUFFER_ID_BACK];
+	} else {
+		buffer = drawable->pixmap.buffer;
+	}
+
+	if (!buffer)
+		return WSEGL_BAD_DRAWABLE;
+
+	return wayland_copy_to_pixmap(drawable->display, buffer,
+				      native_pixmap);
 }
 
 static WSEGLError
@@ -556,9 +1245,11 @@ WSEGL_CopyFromPBuffer(void *addr,
 	if (native_pixmap == NULL)
 		return WSEGL_BAD_NATIVE_PIXMAP;
 
-	//FIXME: implement this
+	if (addr == NULL)
+		return WSEGL_BAD_MATCH;
 
-	return WSEGL_BAD_NATIVE_PIXMAP;
+	return wayland_copy_pbuffer_to_pixmap(addr, width, height, stride,
+					      pixel_format, native_pixmap);
 }
 
 static void
@@ -574,19 +1265,144 @@ get_buffer_parameters(struct wayland_buffer *buffer,
 	params->hPrivateData = buffer->meminfo->hPrivateData;
 }
 
-static void
-buffer_release(void *data, struct wl_buffer *wl_buffer)
+/* get a buffer of the drawable size and account it to the window */
+static struct wayland_buffer *
+window_alloc_buffer(struct wayland_drawable *drawable)
 {
-	struct wayland_buffer *buffer = data;
+	struct wayland_display *display = drawable->display;
+	struct wayland_window *window = &drawable->window;
+	struct wl_egl_window *egl_window = window->egl_window;
+	struct wayland_buffer *buffer;
+	WSEGLError err;
+
+	buffer = wayland_reuse_buffer(display, window->wl_queue,
+				      drawable->width, drawable->height,
+				      drawable->format, egl_window->bypass_hint);
+	if (buffer) {
+		wayland_memory_set_owner(display, buffer,
+					 &egl_window->memory_usage);
+		return buffer;
+	}
+
+	err = wayland_alloc_buffer(display, window->shm_pool, window->wl_queue,
+				   drawable->width, drawable->height,
+				   drawable->format, &buffer);
+	if (err != WSEGL_SUCCESS) {
+		__atomic_add_fetch(&egl_window->memory_usage.failures, 1,
+				   __ATOMIC_RELAXED);
+		return NULL;
+	}
 
-	dbg("release buffer %d", buffer->id);
+	egl_window->frame_stats.buffers_allocated++;
+	wayland_memory_set_owner(display, buffer, &egl_window->memory_usage);
 
-	buffer->lock = false;
+	return buffer;
 }
 
-static const struct wl_buffer_listener buffer_listener = {
-	buffer_release
-};
+/* make sure an unlocked buffer of the pool matches the drawable size,
+ * resizing it in place when its allocation is large enough or replacing
+ * it otherwise.
+ */
+static struct wayland_buffer *
+window_prepare_buffer(struct wayland_drawable *drawable, int index)
+{
+	struct wayland_display *display = drawable->display;
+	struct wayland_window *window = &drawable->window;
+	struct wayland_buffer *buffer = window->bufferpool[index];
+	struct wayland_buffer *new_buffer;
+	bool bypass = window->egl_window->bypass_hint;
+	WSEGLError err;
+
+	/* planes only scan out buffers covering their whole surface */
+	if (buffer->width == drawable->width &&
+	    buffer->height == drawable->height &&
+	    (!bypass || (buffer->width == buffer->alloc_width &&
+			 buffer->height == buffer->alloc_height)))
+		return buffer;
+
+	if (!bypass) {
+		err = wayland_resize_buffer(display, buffer,
+					    drawable->width, drawable->height);
+		if (err == WSEGL_SUCCESS)
+			return buffer;
+	}
+
+	new_buffer = window_alloc_buffer(drawable);
+	if (!new_buffer)
+		return NULL;
+
+	for (int i = 0; i < BUFFER_ID_MAX; i++) {
+		if (window->buffers[i] == buffer)
+			window->buffers[i] = NULL;
+	}
+
+	wayland_release_buffer(display, buffer);
+	window->bufferpool[index] = new_buffer;
+
+	return new_buffer;
+}
+
+/* Free the buffers the window did not need over the last trim_frames
+ * frames, but never below min_buffers. A lowered max_buffers applies
+ * right away. Buffers are destroyed rather than cached since their
+ * memory is what we are after. */
+static void
+window_trim_buffers(struct wayland_drawable *drawable)
+{
+	struct wayland_display *display = drawable->display;
+	struct wayland_window *window = &drawable->window;
+	struct wl_egl_window *egl_window = window->egl_window;
+	int in_use = 1;	/* the buffer about to be rendered to */
+	int target;
+
+	window->min_buffers = egl_window->min_buffers ?
+		egl_window->min_buffers : 2;
+	window->max_buffers = egl_window->max_buffers ?
+		egl_window->max_buffers : BUFFER_COUNT;
+
+	for (int i = 0; i < window->num_buffers; i++)
+		if (wayland_buffer_is_locked(window->bufferpool[i]))
+			in_use++;
+
+	if (in_use > window->peak_buffers)
+		window->peak_buffers = in_use;
+
+	if (window->num_buffers > window->max_buffers) {
+		target = window->max_buffers;
+	} else if (window->trim_frames > 0 &&
+		   ++window->trim_count >= window->trim_frames) {
+		target = window->peak_buffers;
+		if (target < window->min_buffers)
+			target = window->min_buffers;
+
+		window->trim_count = 0;
+		window->peak_buffers = in_use;
+	} else {
+		return;
+	}
+
+	wayland_window_free_buffers(display, window, target);
+}
+
+/* pick the unlocked buffer presented most recently, its content is the
+ * closest to the next frame which keeps the buffer age low */
+static int
+window_find_unlocked_buffer(struct wayland_window *window)
+{
+	int index = -1;
+
+	for (int i = 0; i < window->num_buffers; i++) {
+		struct wayland_buffer *buffer = window->bufferpool[i];
+
+		if (wayland_buffer_is_locked(buffer))
+			continue;
+
+		if (index < 0 || buffer->frame > window->bufferpool[index]->frame)
+			index = i;
+	}
+
+	return index;
+}
 
 static struct wayland_buffer *
 window_get_render_buffer(struct wayland_drawable *drawable)
@@ -594,39 +1410,39 @@ window_get_render_buffer(struct wayland_drawable *drawable)
 	struct wayland_display *display = drawable->display;
 	struct wayland_window *window = &drawable->window;
 	struct wayland_buffer *buffer;
+	uint64_t start;
+	int index, seq;
+
+	/* process received events, a buffer release might be pending; the
+	 * release thread, if any, already does the socket reads */
+	if (display->release.queue)
+		wl_display_dispatch_queue_pending(display->wl_display,
+						  window->wl_queue);
+	else if (window->wl_queue)
+		wayland_dispatch_pending(display, window->wl_queue);
+
+	seq = wayland_release_seq(display);
 
-	/* process queued event, a buffer release might be pending */
-	wl_display_dispatch_queue_pending(display->wl_display,
-					  display->wl_queue);
+	window_trim_buffers(drawable);
 
 	/* try to use an already allocated and unlocked buffer */
-	for (int i = 0; i < window->num_buffers; i++) {
-		if (!window->bufferpool[i]->lock)
-			return window->bufferpool[i];
-	}
+	index = window_find_unlocked_buffer(window);
+	if (index >= 0)
+		return window_prepare_buffer(drawable, index);
 
 	/* try to allocate a new buffer */
 	if (window->num_buffers < window->max_buffers) {
-		WSEGLError err;
-
-		err = wayland_alloc_buffer(display,
-					   window->egl_window->width,
-					   window->egl_window->height,
-					   drawable->format, &buffer);
-		if (err == WSEGL_SUCCESS) {
-			wl_buffer_add_listener(buffer->wl_buffer,
-					       &buffer_listener, buffer);
-
+		buffer = window_alloc_buffer(drawable);
+		if (buffer) {
 			window->bufferpool[window->num_buffers++] = buffer;
-
 			return buffer;
 		}
 	}
 
-	/* wait for a buffer to be unlocked; this should not happen
-	 * since there can be four buffers to handle the worst case
-	 * scenario, when the window back buffer is used as scanout
-	 * and the swap interval is 0.
+	/* wait for a buffer to be unlocked; with the default depth this
+	 * should not happen since there can be four buffers to handle the
+	 * worst case scenario, when the window back buffer is used as
+	 * scanout and the swap interval is 0.
 	 */
 	if (window->num_buffers < 2) {
 		dbg("not enough buffers for window");
@@ -635,22 +1451,39 @@ window_get_render_buffer(struct wayland_drawable *drawable)
 
 	dbg("wait for buffer");
 
+	start = get_time_ns();
+
 	for (buffer = NULL; !buffer; ) {
-		int ret = wl_display_dispatch_queue(display->wl_display,
-						    display->wl_queue);
+		int ret;
+
+		if (window->acquire_timeline &&
+		    wayland_window_wait_release(window)) {
+			/* no wl_buffer.release comes for these buffers */
+			ret = wayland_dispatch_pending(display,
+						       window->wl_queue);
+		} else if (display->release.queue)
+			ret = wayland_release_wait(display, seq);
+		else
+			ret = wl_display_dispatch_queue(display->wl_display,
+							window->wl_queue);
 		if (ret < 0) {
 			dbg("failed to wait for buffer");
 			return NULL;
 		}
 
-		for (int i = 0; i < window->num_buffers; i++) {
-			if (!window->bufferpool[i]->lock) {
-				buffer = window->bufferpool[i];
-				break;
-			}
+		seq = wayland_release_seq(display);
+
+		index = window_find_unlocked_buffer(window);
+		if (index >= 0) {
+			buffer = window_prepare_buffer(drawable, index);
+			if (!buffer)
+				return NULL;
 		}
 	}
 
+	wayland_latency_add(&window->egl_window->frame_stats.buffer_wait,
+			    start);
+
 	dbg("  -> done");
 
 	return buffer;
@@ -667,27 +1500,50 @@ WSEGL_GetDrawableParameters(WSEGLDrawableHandle drawable_handle,
 
 	if (drawable->type == WSEGL_DRAWABLE_WINDOW) {
 		struct wayland_window *window = &drawable->window;
-
-		if (drawable->width != window->egl_window->width ||
-		    drawable->height != window->egl_window->height) {
-			dbg("window size changed, recreate drawable");
-			return WSEGL_BAD_DRAWABLE;
+		struct wl_egl_window *egl_window = window->egl_window;
+
+		if (drawable->width != egl_window->width ||
+		    drawable->height != egl_window->height) {
+			dbg("window size changed to %dx%d",
+			    egl_window->width, egl_window->height);
+			drawable->width = egl_window->width;
+			drawable->height = egl_window->height;
 		}
 
+		/* the attach offset given to wl_egl_window_resize applies
+		 * once, to the next buffer attached to the surface */
+		window->dx += egl_window->dx;
+		window->dy += egl_window->dy;
+		egl_window->dx = 0;
+		egl_window->dy = 0;
+
+		pthread_mutex_lock(&window->lock);
+
 		rbuffer = window_get_render_buffer(drawable);
-		if (!rbuffer)
+		if (!rbuffer) {
+			pthread_mutex_unlock(&window->lock);
 			return WSEGL_OUT_OF_MEMORY;
+		}
 
 		sbuffer = window->buffers[BUFFER_ID_FRONT];
-		if (!sbuffer)
+		if (!sbuffer || sbuffer->width != rbuffer->width ||
+		    sbuffer->height != rbuffer->height)
 			sbuffer = rbuffer;
 
 		dbg("render to %d", rbuffer->id);
 
+		if (rbuffer->frame)
+			egl_window->buffer_age =
+				window->frame_count - rbuffer->frame + 1;
+		else
+			egl_window->buffer_age = 0;
+
 		window->buffers[BUFFER_ID_BACK] = rbuffer;
 		window->egl_window->attached_width = drawable->width;
 		window->egl_window->attached_height = drawable->height;
 
+		pthread_mutex_unlock(&window->lock);
+
 	} else {
 		struct wayland_pixmap *pixmap = &drawable->pixmap;
 
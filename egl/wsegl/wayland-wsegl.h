@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <time.h>
 
 #include <EGL/eglplatform.h>
 #include <wsegl.h>
@@ -16,6 +17,7 @@
 
 #include "wayland-gdl.h"
 #include "wayland-egl-priv.h"
+#include "presentation-time-client-protocol.h"
 
 #undef DEBUG
 
@@ -27,16 +29,130 @@
 #endif
 # define err(fmt, ...)	fprintf(stderr, "EGL/wayland: "fmt"\n", ##__VA_ARGS__)
 
-#define BUFFER_COUNT	4
+#define BUFFER_COUNT	WL_EGL_WINDOW_MAX_BUFFERS
+#define MAX_SWAP_INTERVAL	4
+
+/* frames without buffer pressure before a window frees its spare
+ * buffers, see EGL_BUFFER_TRIM_FRAMES */
+#define BUFFER_TRIM_FRAMES	120
+
+/* damage rectangles sent per frame before falling back to full damage */
+#define DAMAGE_RECT_MAX	8
+
+/* window configs built from the formats advertised by wl_gdl */
+#define CONFIG_MAX	8
+
+/* default budget of the unused buffer cache, in kilobytes */
+#define BUFFER_CACHE_SIZE	16384
+
+enum wayland_convert_flags {
+	CONVERT_DITHER = (1 << 0),
+	CONVERT_NO_SIMD = (1 << 1),
+};
+
+struct wayland_buffer_cache {
+	pthread_mutex_t lock;
+	struct wl_list buffers;
+	size_t size;
+	size_t max_size;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+struct wayland_release_thread {
+	pthread_t thread;
+	pthread_mutex_t dispatch_lock;	/* held while running handlers */
+	struct wl_event_queue *queue;
+	int wake_fd;
+	bool running;
+	int seq;
+};
+
+struct wayland_timeline {
+	int refcount;
+	struct wl_gdl_timeline_page *page;
+	struct wl_gdl_timeline *wl_timeline;
+	uint64_t point;		/* last point handed out */
+};
+
+struct wayland_fence_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct wl_list fences;
+	pthread_t thread;
+	bool running;
+	bool stop;
+	PVR2DMEMINFO *current;	/* fence being waited on by the thread */
+};
+
+struct wayland_idle {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct wl_list windows;
+	pthread_t thread;
+	bool running;
+	bool stop;
+	bool wake;
+	uint64_t timeout_ns;
+};
+
+/* without a compositor frames retire at swap, optionally into a dump */
+struct wayland_headless {
+	bool enabled;
+	pthread_mutex_t lock;
+	FILE *dump;
+	bool dump_pipe;
+	int width;
+	int height;
+	const struct wayland_pixel_format *format;
+};
+
+struct wayland_memory {
+	pthread_mutex_t lock;
+	struct wl_egl_memory_stats stats;
+	uint64_t log_interval_ns;
+	uint64_t last_log_ns;
+	bool log_pending;	/* changed since the last line */
+};
+
+struct wayland_shm_pool {
+	int refcount;
+	int fd;
+	size_t size;
+	struct wl_shm_pool *wl_pool;
+	pthread_mutex_t lock;
+	struct wl_array free_ranges;
+};
+
+struct wayland_gdl_format {
+	const struct wayland_pixel_format *format;
+	uint32_t flags;
+};
 
 struct wayland_display {
 	struct wl_display *wl_display;
 	struct wl_event_queue *wl_queue;
 	struct wl_gdl *wl_gdl;
 	struct wl_shm *wl_shm;
+	struct wl_gdl_explicit_sync *wl_gdl_sync;
+	struct wp_presentation *wp_presentation;
+	clockid_t presentation_clock;
 	bool gdl_init;
 	PVR2DCONTEXTHANDLE pvr2d_context;
 	pthread_mutex_t pvr2d_lock;
+	struct wl_list pixmap_copies;
+	bool sync_copies;
+	enum wayland_convert_flags convert_flags;
+	struct wayland_buffer_cache cache;
+	struct wayland_release_thread release;
+	struct wayland_fence_queue fences;
+	struct wayland_idle idle;
+	struct wayland_memory memory;
+	struct wayland_headless headless;
+	struct wl_array gdl_formats;
+	WSEGLConfig configs[CONFIG_MAX + 1];
+	struct wl_egl_display egl_display;
 };
 
 enum wayland_buffer_id {
@@ -51,21 +167,36 @@ struct wayland_pixel_format {
 	gma_pixel_format_t gma_pf;
 	enum wl_shm_format wl_pf;
 	WSEGLPixelFormat wsegl_pf;
+	PVR2DFORMAT pvr2d_pf;
 	int bpp;
 	bool has_alpha;
 	bool renderable;
+	bool yuv;
 };
 
 struct wayland_buffer {
+	struct wayland_display *display;
 	int id;
 	int width;
 	int height;
 	int pitch;
+	int alloc_width;
+	int alloc_height;
 	bool lock;
+	uint64_t frame;
 	struct wl_buffer *wl_buffer;
+	struct wl_event_queue *wl_queue;
 	const struct wayland_pixel_format *format;
 	PVR2DMEMINFO *meminfo;
 	gma_pixmap_t pixmap;
+	struct wayland_shm_pool *shm_pool;
+	size_t shm_offset;
+	struct wayland_timeline *release_timeline;
+	uint64_t release_point;	/* 0 if released with wl_buffer.release */
+	size_t mem_size;	/* accounted bytes, 0 if not allocated by us */
+	enum wl_egl_memory_backend mem_backend;
+	struct wl_egl_memory_usage *mem_owner;
+	struct wl_list link;
 };
 
 struct wayland_pixmap {
@@ -73,13 +204,34 @@ struct wayland_pixmap {
 };
 
 struct wayland_window {
+	pthread_mutex_t lock;	/* buffers, against the idle thread */
 	struct wayland_buffer *buffers[BUFFER_ID_MAX];
 	struct wayland_buffer *bufferpool[BUFFER_COUNT];
 	struct wl_callback *throttle_cb;
+	struct wl_event_queue *wl_queue;
 	struct wl_egl_window *egl_window;
+	struct wayland_shm_pool *shm_pool;
+	struct wayland_timeline *acquire_timeline;
 	int num_buffers;
+	int min_buffers;
 	int max_buffers;
+	int peak_buffers;	/* most buffers in use since the last trim */
+	int trim_frames;
+	int trim_count;
 	int swap_interval;
+	int throttle_frames;	/* swap interval of the pending frame */
+	uint64_t throttle_deadline;
+	uint64_t frame_count;
+	uint64_t rate_start;
+	uint64_t rate_swaps;
+	struct wl_list presentation_feedbacks;
+	struct wl_gdl_surface *gdl_surface;
+	int bypass_hint;	/* last hint sent to the compositor */
+	bool visible;
+	uint64_t last_swap_ns;
+	struct wl_list idle_link;
+	int dx;
+	int dy;
 };
 
 struct wayland_drawable {
@@ -100,8 +252,10 @@ static inline int align(int value, int alignment)
 }
 
 bool debug_get_bool_option(const char *name, bool dfault);
+long debug_get_num_option(const char *name, long dfault);
 const char *pvr2d_strerror(PVR2DERROR err);
 uint64_t get_time_ms(void);
+uint64_t get_time_ns(void);
 
 /* pixel format conversion functions */
 const struct wayland_pixel_format *
@@ -111,8 +265,120 @@ convert_gma_pixel_format(gma_pixel_format_t pf);
 const struct wayland_pixel_format *
 convert_wsegl_pixel_format(WSEGLPixelFormat pf);
 
+/* pixel conversion functions */
+typedef void (*wayland_convert_func_t)(uint8_t *dst, const uint8_t *src,
+				       int width, int y);
+
+wayland_convert_func_t
+wayland_get_convert_func(const struct wayland_pixel_format *src,
+			 const struct wayland_pixel_format *dst,
+			 enum wayland_convert_flags flags);
+
+void wayland_convert_pixels(wayland_convert_func_t func,
+			    void *dst, int dst_pitch,
+			    const void *src, int src_pitch,
+			    int width, int height);
+
+/* frame statistics functions */
+void wayland_window_stats_init(struct wayland_window *window);
+
+void wayland_window_stats_fini(struct wayland_window *window);
+
+void wayland_window_stats_swap(struct wayland_window *window);
+
+void wayland_latency_add(struct wl_egl_latency_stats *stats, uint64_t start);
+
+/* presentation feedback functions */
+void wayland_window_presentation_init(struct wayland_window *window);
+
+void wayland_window_presentation_fini(struct wayland_window *window);
+
+void wayland_window_request_presentation(struct wayland_display *display,
+					 struct wayland_window *window);
+
+uint64_t
+wayland_window_presentation_deadline(struct wayland_display *display,
+				     struct wayland_window *window,
+				     int interval);
+
+void wayland_presentation_sleep(struct wayland_display *display,
+				uint64_t deadline);
+
+/* release thread functions */
+void wayland_release_thread_start(struct wayland_display *display);
+
+void wayland_release_thread_stop(struct wayland_display *display);
+
+int wayland_release_seq(struct wayland_display *display);
+
+void wayland_release_notify(struct wayland_display *display);
+
+int wayland_release_wait(struct wayland_display *display, int seq);
+
+void wayland_release_lock(struct wayland_display *display);
+
+void wayland_release_unlock(struct wayland_display *display);
+
+/* idle window functions */
+void wayland_idle_init(struct wayland_display *display);
+
+void wayland_idle_fini(struct wayland_display *display);
+
+void wayland_idle_wake(struct wayland_display *display);
+
+void wayland_window_idle_init(struct wayland_display *display,
+			      struct wayland_window *window);
+
+void wayland_window_idle_fini(struct wayland_display *display,
+			      struct wayland_window *window);
+
+int wayland_window_free_buffers(struct wayland_display *display,
+				struct wayland_window *window, int target);
+
+/* headless functions */
+void wayland_headless_init(struct wayland_display *display);
+
+void wayland_headless_fini(struct wayland_display *display);
+
+void wayland_headless_present(struct wayland_display *display,
+			      struct wayland_window *window,
+			      struct wayland_buffer *buffer);
+
+/* memory accounting functions */
+void wayland_memory_init(struct wayland_display *display);
+
+void wayland_memory_fini(struct wayland_display *display);
+
+void wayland_memory_tick(struct wayland_display *display);
+
+void wayland_memory_alloc(struct wayland_display *display,
+			  struct wayland_buffer *buffer);
+
+void wayland_memory_free(struct wayland_display *display,
+			 struct wayland_buffer *buffer);
+
+void wayland_memory_failed(struct wayland_display *display,
+			   const struct wayland_pixel_format *format);
+
+void wayland_memory_set_owner(struct wayland_display *display,
+			      struct wayland_buffer *buffer,
+			      struct wl_egl_memory_usage *owner);
+
+void wayland_memory_get_stats(void *data, struct wl_egl_memory_stats *stats);
+
+/* event functions */
+int wayland_dispatch_pending(struct wayland_display *display,
+			     struct wl_event_queue *queue);
+
 /* buffer functions */
+struct wayland_buffer *
+wayland_reuse_buffer(struct wayland_display *display,
+		     struct wl_event_queue *queue, int width, int height,
+		     const struct wayland_pixel_format *format, bool scanout);
+
 WSEGLError wayland_alloc_buffer(struct wayland_display *display,
+				struct wayland_shm_pool *pool,
+				struct wl_event_queue *queue,
 				int width, int height,
 				const struct wayland_pixel_format *format,
 				struct wayland_buffer **out_buffer);
@@ -120,6 +386,13 @@ WSEGLError wayland_alloc_buffer(struct wayland_display *display,
 void wayland_destroy_buffer(struct wayland_display *display,
 			    struct wayland_buffer *buffer);
 
+void wayland_release_buffer(struct wayland_display *display,
+			    struct wayland_buffer *buffer);
+
+WSEGLError wayland_resize_buffer(struct wayland_display *display,
+				 struct wayland_buffer *buffer,
+				 int width, int height);
+
 WSEGLError wayland_bind_gma_buffer(struct wayland_display *display,
 				   struct wayland_buffer *buffer,
 				   gma_pixmap_t pixmap);
@@ -127,4 +400,71 @@ WSEGLError wayland_bind_gma_buffer(struct wayland_display *display,
 void wayland_unbind_buffer(struct wayland_display *display,
 			   struct wayland_buffer *buffer);
 
+size_t wayland_shm_buffer_size(int width, int height,
+			       const struct wayland_pixel_format *format);
+
+/* explicit sync functions */
+struct wayland_timeline *wayland_timeline_create(struct wayland_display *display);
+
+struct wayland_timeline *
+wayland_timeline_ref(struct wayland_timeline *timeline);
+
+void wayland_timeline_unref(struct wayland_timeline *timeline);
+
+void wayland_fence_init(struct wayland_display *display);
+
+void wayland_fence_fini(struct wayland_display *display);
+
+void wayland_fence_flush(struct wayland_display *display);
+
+void wayland_fence_flush_meminfo(struct wayland_display *display,
+				 PVR2DMEMINFO *meminfo);
+
+bool wayland_window_sync_init(struct wayland_display *display,
+			      struct wayland_window *window);
+
+void wayland_window_sync_fini(struct wayland_display *display,
+			      struct wayland_window *window);
+
+bool wayland_window_sync_buffer(struct wayland_display *display,
+				struct wayland_window *window,
+				struct wayland_buffer *buffer);
+
+bool wayland_window_wait_release(struct wayland_window *window);
+
+bool wayland_buffer_is_locked(struct wayland_buffer *buffer);
+
+/* SHM pool functions */
+int wayland_create_anonymous_file(void);
+
+struct wayland_shm_pool *
+wayland_shm_pool_create(struct wayland_display *display, size_t size);
+
+struct wayland_shm_pool *
+wayland_shm_pool_ref(struct wayland_shm_pool *pool);
+
+void wayland_shm_pool_unref(struct wayland_shm_pool *pool);
+
+long wayland_shm_pool_alloc(struct wayland_shm_pool *pool, size_t size);
+
+void wayland_shm_pool_free(struct wayland_shm_pool *pool,
+			   size_t offset, size_t size);
+
+/* buffer cache functions */
+void wayland_buffer_cache_init(struct wayland_display *display);
+
+void wayland_buffer_cache_fini(struct wayland_display *display);
+
+struct wayland_buffer *
+wayland_buffer_cache_get(struct wayland_display *display,
+			 int width, int height,
+			 const struct wayland_pixel_format *format,
+			 bool scanout);
+
+bool wayland_buffer_cache_put(struct wayland_display *display,
+			      struct wayland_buffer *buffer);
+
+void wayland_buffer_cache_get_stats(void *data,
+				    struct wl_egl_buffer_cache_stats *stats);
+
 #endif /* !WAYLAND_WSEGL_H */
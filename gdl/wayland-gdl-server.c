@@ -1,19 +1,290 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <gdl.h>
 
 #include "wayland-gdl-server.h"
 
+#ifndef F_GET_SEALS
+# define F_GET_SEALS		(1024 + 10)
+# define F_SEAL_SHRINK		0x0002
+#endif
+
+struct wl_gdl_timeline {
+	int refcount;
+	struct wl_gdl_timeline_page *page;
+};
+
+/* surface info looked up once per GDL surface and shared by all the
+ * buffers created from it */
+struct gdl_surface {
+	int refcount;
+	struct wl_client *client;
+	gdl_surface_info_t info;
+	struct wl_list link;
+};
+
+static struct wl_list surfaces = { &surfaces, &surfaces };
+
+/* wl_gdl_surface state, found back from its wl_surface through the
+ * destroy listener it adds to it */
+struct bypass_state {
+	struct wl_resource *resource;
+	struct wl_resource *surface;
+	struct wl_listener surface_destroy_listener;
+	uint32_t hint;
+	bool active;
+	bool visible;
+};
+
+/* formats advertised to wl_gdl clients, in order of preference */
+static struct {
+	gdl_pixel_format_t pixel_format;
+	uint32_t flags;
+} formats[] = {
+	{ GDL_PF_ARGB_32,	WL_GDL_FORMAT_FLAGS_SCANOUT |
+				WL_GDL_FORMAT_FLAGS_COMPOSITED },
+	{ GDL_PF_RGB_32,	WL_GDL_FORMAT_FLAGS_SCANOUT |
+				WL_GDL_FORMAT_FLAGS_COMPOSITED },
+	{ GDL_PF_RGB_16,	WL_GDL_FORMAT_FLAGS_SCANOUT |
+				WL_GDL_FORMAT_FLAGS_COMPOSITED },
+	{ GDL_PF_ARGB_16_1555,	WL_GDL_FORMAT_FLAGS_SCANOUT |
+				WL_GDL_FORMAT_FLAGS_COMPOSITED },
+	{ GDL_PF_ARGB_16_4444,	WL_GDL_FORMAT_FLAGS_SCANOUT |
+				WL_GDL_FORMAT_FLAGS_COMPOSITED },
+	{ GDL_PF_NV12,		WL_GDL_FORMAT_FLAGS_SCANOUT },
+	{ GDL_PF_NV16,		WL_GDL_FORMAT_FLAGS_SCANOUT },
+	{ GDL_PF_YUY2,		WL_GDL_FORMAT_FLAGS_SCANOUT },
+	{ GDL_PF_UYVY,		WL_GDL_FORMAT_FLAGS_SCANOUT },
+	{ GDL_PF_YV12,		WL_GDL_FORMAT_FLAGS_SCANOUT },
+	{ GDL_PF_I420,		WL_GDL_FORMAT_FLAGS_SCANOUT },
+};
+
+#define FORMAT_COUNT (sizeof (formats) / sizeof (*formats))
+
+/* memory layout of the formats buffers can be created with: bytes per
+ * pixel of the first plane, then chroma subsampling and bytes per sample
+ * of the chroma planes */
+struct format_layout {
+	gdl_pixel_format_t pixel_format;
+	int planes;
+	int cpp;
+	int hsub;
+	int vsub;
+	int uv_cpp;
+	bool yuv;
+};
+
+static const struct format_layout layouts[] = {
+	{ GDL_PF_ARGB_32,	1, 4, 1, 1, 0, false },
+	{ GDL_PF_RGB_32,	1, 4, 1, 1, 0, false },
+	{ GDL_PF_ARGB_16_1555,	1, 2, 1, 1, 0, false },
+	{ GDL_PF_ARGB_16_4444,	1, 2, 1, 1, 0, false },
+	{ GDL_PF_RGB_16,	1, 2, 1, 1, 0, false },
+	{ GDL_PF_AY16,		1, 2, 1, 1, 0, false },
+	{ GDL_PF_A8,		1, 1, 1, 1, 0, false },
+	{ GDL_PF_YUY2,		1, 2, 1, 1, 0, true },
+	{ GDL_PF_UYVY,		1, 2, 1, 1, 0, true },
+	{ GDL_PF_YVYU,		1, 2, 1, 1, 0, true },
+	{ GDL_PF_VYUY,		1, 2, 1, 1, 0, true },
+	{ GDL_PF_NV12,		2, 1, 2, 2, 2, true },
+	{ GDL_PF_NV16,		2, 1, 2, 1, 2, true },
+	{ GDL_PF_YV12,		3, 1, 2, 2, 1, true },
+	{ GDL_PF_I420,		3, 1, 2, 2, 1, true },
+	{ GDL_PF_YV16,		3, 1, 2, 1, 1, true },
+	{ GDL_PF_I422,		3, 1, 2, 1, 1, true },
+};
+
+#define LAYOUT_COUNT (sizeof (layouts) / sizeof (*layouts))
+
+/* a buffer wrapped for one PVR2D context */
+struct buffer_meminfo {
+	PVR2DCONTEXTHANDLE context;
+	PVR2DMEMINFO *meminfo;
+	struct wl_list link;
+};
+
 struct wl_gdl_buffer {
 	struct wl_resource *resource;
+	struct gdl_surface *surface;
+	uint32_t offset;
+	struct wl_gdl_timeline *acquire_timeline;
+	struct wl_gdl_timeline *release_timeline;
+	uint64_t acquire_point;
+	uint64_t release_point;
 	gdl_surface_info_t surface_info;
+	gdl_uint8 *data;
+	gma_pixmap_t pixmap;
+	struct wl_list meminfos;
+	gdl_plane_id_t plane;
+	bool retired;
+	struct wl_list plane_link;
+};
+
+/* scanout state of a universal pixel plane: the buffer flipped last,
+ * and the buffers it replaced which may still be scanned out until the
+ * next vblank */
+struct gdl_plane {
+	struct wl_gdl_buffer *front;
+	struct wl_list retired;
+	bool configured;
+	gdl_pixel_format_t pixel_format;
+	gdl_uint32 src_width;
+	gdl_uint32 src_height;
+	gdl_rectangle_t rect;
 };
 
+/* indexed by plane id, the ids of universal pixel planes do not start
+ * at 0 */
+static struct gdl_plane planes[GDL_PLANE_ID_UPP_E + 1];
+
+static struct gdl_plane *
+get_plane(gdl_plane_id_t id)
+{
+	struct gdl_plane *plane;
+
+	if (id < GDL_PLANE_ID_UPP_A || id > GDL_PLANE_ID_UPP_E)
+		return NULL;
+
+	plane = &planes[id];
+	if (!plane->retired.next)
+		wl_list_init(&plane->retired);
+
+	return plane;
+}
+
+static void
+plane_retire_front(struct gdl_plane *plane)
+{
+	struct wl_gdl_buffer *buffer = plane->front;
+
+	if (!buffer)
+		return;
+
+	buffer->retired = true;
+	wl_list_insert(plane->retired.prev, &buffer->plane_link);
+	plane->front = NULL;
+}
+
+/* Surface info is cached per client while the client has buffers of the
+ * surface, which all get destroyed with the client. A freed surface id
+ * may be reused by another client for different memory, so entries are
+ * never shared between clients. */
+static gdl_ret_t
+surface_lookup(struct wl_client *client, gdl_surface_id_t name,
+	       struct gdl_surface **out_surface)
+{
+	struct gdl_surface *surface;
+	gdl_ret_t rc;
+
+	wl_list_for_each(surface, &surfaces, link) {
+		if (surface->client == client && surface->info.id == name) {
+			surface->refcount++;
+			*out_surface = surface;
+			return GDL_SUCCESS;
+		}
+	}
+
+	surface = malloc(sizeof (*surface));
+	if (!surface)
+		return GDL_ERR_NO_MEMORY;
+
+	rc = gdl_get_surface_info(name, &surface->info);
+	if (rc != GDL_SUCCESS) {
+		free(surface);
+		return rc;
+	}
+
+	surface->client = client;
+	surface->refcount = 1;
+	wl_list_insert(&surfaces, &surface->link);
+	*out_surface = surface;
+
+	return GDL_SUCCESS;
+}
+
+static void
+surface_unref(struct gdl_surface *surface)
+{
+	if (--surface->refcount > 0)
+		return;
+
+	wl_list_remove(&surface->link);
+	free(surface);
+}
+
+static struct wl_gdl_timeline *
+timeline_ref(struct wl_gdl_timeline *timeline)
+{
+	timeline->refcount++;
+	return timeline;
+}
+
+static void
+timeline_unref(struct wl_gdl_timeline *timeline)
+{
+	if (!timeline || --timeline->refcount > 0)
+		return;
+
+	munmap(timeline->page, sizeof (*timeline->page));
+	free(timeline);
+}
+
+static void
+buffer_clear_sync(struct wl_gdl_buffer *buffer)
+{
+	timeline_unref(buffer->acquire_timeline);
+	timeline_unref(buffer->release_timeline);
+	buffer->acquire_timeline = NULL;
+	buffer->release_timeline = NULL;
+}
+
 static void
 destroy_buffer(struct wl_resource *resource)
 {
 	struct wl_gdl_buffer *buffer = wl_resource_get_user_data(resource);
+	struct buffer_meminfo *mi, *tmp;
+
+	/* do not leave the client waiting on a buffer it no longer has */
+	if (buffer->release_timeline)
+		wl_gdl_timeline_signal(buffer->release_timeline->page,
+				       buffer->release_point);
+	buffer_clear_sync(buffer);
+
+	/* the client may free the surface right after, make sure no plane
+	 * scans it out anymore: disable the plane showing it, or wait for
+	 * the vblank that completes the flip away from it */
+	if (buffer->plane != GDL_PLANE_ID_UNDEFINED) {
+		struct gdl_plane *plane = get_plane(buffer->plane);
 
+		if (buffer->retired) {
+			wl_list_remove(&buffer->plane_link);
+			gdl_display_wait_for_vblank(GDL_DISPLAY_ID_0, NULL);
+		} else {
+			gdl_flip(buffer->plane, GDL_SURFACE_INVALID,
+				 GDL_FLIP_SYNC);
+			plane->front = NULL;
+			plane->configured = false;
+		}
+	}
+
+	wl_list_for_each_safe(mi, tmp, &buffer->meminfos, link) {
+		PVR2DMemFree(mi->context, mi->meminfo);
+		free(mi);
+	}
+
+	if (buffer->pixmap)
+		gma_pixmap_release(&buffer->pixmap);
+
+	if (buffer->data)
+		gdl_unmap_surface(buffer->surface_info.id);
+
+	surface_unref(buffer->surface);
 	free(buffer);
 }
 
@@ -28,28 +299,35 @@ static const struct wl_buffer_interface gdl_buffer_interface = {
 };
 
 static void
-create_buffer(struct wl_client *client, struct wl_resource *resource,
-	      uint32_t id, uint32_t name)
+create_gdl_buffer(struct wl_client *client, struct wl_resource *resource,
+		  uint32_t id, struct gdl_surface *surface,
+		  const gdl_surface_info_t *info, uint32_t offset)
 {
 	struct wl_gdl_buffer *buffer;
 
 	buffer = malloc(sizeof (*buffer));
 	if (!buffer) {
+		surface_unref(surface);
 		wl_resource_post_no_memory(resource);
 		return;
 	}
 
-	if (gdl_get_surface_info(name, &buffer->surface_info) != GDL_SUCCESS) {
-		wl_resource_post_error(resource, WL_GDL_ERROR_INVALID_NAME,
-				       "invalid surface id %u", name);
-		free(buffer);
-		return;
-	}
+	buffer->surface = surface;
+	buffer->surface_info = *info;
+	buffer->offset = offset;
+	buffer->acquire_timeline = NULL;
+	buffer->release_timeline = NULL;
+	buffer->data = NULL;
+	buffer->pixmap = NULL;
+	wl_list_init(&buffer->meminfos);
+	buffer->plane = GDL_PLANE_ID_UNDEFINED;
+	buffer->retired = false;
 
 	buffer->resource =
 		wl_resource_create(client, &wl_buffer_interface, 1, id);
 	if (buffer->resource == NULL) {
 		wl_resource_post_no_memory(resource);
+		surface_unref(surface);
 		free(buffer);
 		return;
 	}
@@ -59,8 +337,314 @@ create_buffer(struct wl_client *client, struct wl_resource *resource,
 				       buffer, destroy_buffer);
 }
 
+static bool
+lookup_surface(struct wl_resource *resource, uint32_t name,
+	       struct gdl_surface **surface)
+{
+	gdl_ret_t rc = surface_lookup(wl_resource_get_client(resource),
+				      name, surface);
+
+	if (rc == GDL_ERR_NO_MEMORY) {
+		wl_resource_post_no_memory(resource);
+		return false;
+	}
+
+	if (rc != GDL_SUCCESS) {
+		wl_resource_post_error(resource, WL_GDL_ERROR_INVALID_NAME,
+				       "invalid surface id %u", name);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+create_buffer(struct wl_client *client, struct wl_resource *resource,
+	      uint32_t id, uint32_t name)
+{
+	struct gdl_surface *surface;
+
+	if (!lookup_surface(resource, name, &surface))
+		return;
+
+	create_gdl_buffer(client, resource, id, surface, &surface->info, 0);
+}
+
+static const struct format_layout *
+get_format_layout(gdl_pixel_format_t pixel_format)
+{
+	for (unsigned i = 0; i < LAYOUT_COUNT; i++)
+		if (layouts[i].pixel_format == pixel_format)
+			return &layouts[i];
+
+	return NULL;
+}
+
+static bool
+plane_fits(const gdl_surface_info_t *surface_info, uint32_t offset,
+	   uint32_t pitch, int width, int height, int cpp)
+{
+	uint64_t end;
+
+	if (pitch < (uint64_t) width * cpp)
+		return false;
+
+	/* the whole last row is mapped, including its padding */
+	end = offset + (uint64_t) pitch * height;
+
+	return end <= surface_info->size;
+}
+
+static void
+create_buffer2(struct wl_client *client, struct wl_resource *resource,
+	       uint32_t id, uint32_t name, uint32_t offset,
+	       int32_t width, int32_t height, uint32_t pitch, uint32_t format)
+{
+	const struct format_layout *layout;
+	struct gdl_surface *surface;
+	gdl_surface_info_t info;
+
+	layout = get_format_layout(format);
+	if (!layout || layout->planes > 1) {
+		wl_resource_post_error(resource, WL_GDL_ERROR_INVALID_FORMAT,
+				       "invalid format %u", format);
+		return;
+	}
+
+	if (!lookup_surface(resource, name, &surface))
+		return;
+
+	if (width <= 0 || height <= 0 ||
+	    !plane_fits(&surface->info, offset, pitch,
+			width, height, layout->cpp)) {
+		wl_resource_post_error(resource,
+				       WL_GDL_ERROR_INVALID_DIMENSIONS,
+				       "invalid buffer %dx%d pitch %u at %u "
+				       "in surface %u", width, height, pitch,
+				       offset, name);
+		surface_unref(surface);
+		return;
+	}
+
+	info = surface->info;
+	info.pixel_format = format;
+	info.width = width;
+	info.height = height;
+	info.pitch = pitch;
+	info.size = (uint64_t) pitch * height;
+	info.phys_addr += offset;
+
+	create_gdl_buffer(client, resource, id, surface, &info, offset);
+}
+
+static void
+create_planar_buffer(struct wl_client *client, struct wl_resource *resource,
+		     uint32_t id, uint32_t name,
+		     int32_t width, int32_t height, uint32_t format,
+		     uint32_t y_offset, uint32_t y_pitch,
+		     uint32_t u_offset, uint32_t u_pitch,
+		     uint32_t v_offset, uint32_t v_pitch)
+{
+	const struct format_layout *layout;
+	struct gdl_surface *surface;
+	gdl_surface_info_t info;
+	int uv_width, uv_height;
+	uint64_t end;
+	bool valid;
+
+	layout = get_format_layout(format);
+	if (!layout || layout->planes < 2) {
+		wl_resource_post_error(resource, WL_GDL_ERROR_INVALID_FORMAT,
+				       "invalid planar format %u", format);
+		return;
+	}
+
+	/* semi-planar formats interleave U and V in the second plane */
+	if (layout->planes == 2) {
+		v_offset = u_offset;
+		v_pitch = u_pitch;
+	}
+
+	if (!lookup_surface(resource, name, &surface))
+		return;
+
+	uv_width = (width + layout->hsub - 1) / layout->hsub;
+	uv_height = (height + layout->vsub - 1) / layout->vsub;
+
+	/* chroma planes are addressed relative to the luma plane and share
+	 * their pitch */
+	valid = width > 0 && height > 0 &&
+		u_offset >= y_offset && v_offset >= y_offset &&
+		u_pitch == v_pitch &&
+		plane_fits(&surface->info, y_offset, y_pitch,
+			   width, height, layout->cpp) &&
+		plane_fits(&surface->info, u_offset, u_pitch,
+			   uv_width, uv_height, layout->uv_cpp) &&
+		plane_fits(&surface->info, v_offset, v_pitch,
+			   uv_width, uv_height, layout->uv_cpp);
+
+	if (!valid) {
+		wl_resource_post_error(resource,
+				       WL_GDL_ERROR_INVALID_DIMENSIONS,
+				       "invalid planar buffer %dx%d at %u/%u/%u "
+				       "in surface %u", width, height,
+				       y_offset, u_offset, v_offset, name);
+		surface_unref(surface);
+		return;
+	}
+
+	end = y_offset + (uint64_t) y_pitch * height;
+	if (u_offset + (uint64_t) u_pitch * uv_height > end)
+		end = u_offset + (uint64_t) u_pitch * uv_height;
+	if (v_offset + (uint64_t) v_pitch * uv_height > end)
+		end = v_offset + (uint64_t) v_pitch * uv_height;
+
+	info = surface->info;
+	info.pixel_format = format;
+	info.width = width;
+	info.height = height;
+	info.pitch = y_pitch;
+	info.y_size = (uint64_t) y_pitch * height;
+	info.uv_pitch = u_pitch;
+	info.u_offset = u_offset - y_offset;
+	info.v_offset = v_offset - y_offset;
+	info.size = end - y_offset;
+	info.phys_addr += y_offset;
+
+	create_gdl_buffer(client, resource, id, surface, &info, y_offset);
+}
+
+static void
+bypass_surface_destroyed(struct wl_listener *listener, void *data)
+{
+	struct bypass_state *state =
+		wl_container_of(listener, state, surface_destroy_listener);
+
+	state->surface = NULL;
+}
+
+static void
+destroy_bypass_state(struct wl_resource *resource)
+{
+	struct bypass_state *state = wl_resource_get_user_data(resource);
+
+	if (state->surface)
+		wl_list_remove(&state->surface_destroy_listener.link);
+
+	free(state);
+}
+
+static struct bypass_state *
+get_bypass_state(struct wl_resource *surface)
+{
+	struct wl_listener *listener;
+	struct bypass_state *state;
+
+	listener = wl_resource_get_destroy_listener(surface,
+						    bypass_surface_destroyed);
+	if (!listener)
+		return NULL;
+
+	return wl_container_of(listener, state, surface_destroy_listener);
+}
+
+static void
+gdl_surface_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+gdl_surface_set_bypass(struct wl_client *client,
+		       struct wl_resource *resource, uint32_t hint)
+{
+	struct bypass_state *state = wl_resource_get_user_data(resource);
+
+	state->hint = hint;
+}
+
+static const struct wl_gdl_surface_interface gdl_surface_interface = {
+	gdl_surface_destroy,
+	gdl_surface_set_bypass,
+};
+
+static void
+get_surface(struct wl_client *client, struct wl_resource *resource,
+	    uint32_t id, struct wl_resource *surface)
+{
+	struct bypass_state *state;
+
+	if (get_bypass_state(surface)) {
+		wl_resource_post_error(resource, WL_GDL_ERROR_SURFACE_EXISTS,
+				       "surface already has a wl_gdl_surface");
+		return;
+	}
+
+	state = calloc(1, sizeof (*state));
+	if (!state) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	state->resource =
+		wl_resource_create(client, &wl_gdl_surface_interface,
+				   wl_resource_get_version(resource), id);
+	if (!state->resource) {
+		wl_resource_post_no_memory(resource);
+		free(state);
+		return;
+	}
+
+	state->visible = true;
+	state->surface = surface;
+	state->surface_destroy_listener.notify = bypass_surface_destroyed;
+	wl_resource_add_destroy_listener(surface,
+					 &state->surface_destroy_listener);
+
+	wl_resource_set_implementation(state->resource, &gdl_surface_interface,
+				       state, destroy_bypass_state);
+}
+
+bool
+wl_gdl_surface_bypass_preferred(struct wl_resource *surface)
+{
+	struct bypass_state *state = get_bypass_state(surface);
+
+	return state && state->hint == WL_GDL_SURFACE_BYPASS_PREFERRED;
+}
+
+void
+wl_gdl_surface_set_bypass_active(struct wl_resource *surface, bool active)
+{
+	struct bypass_state *state = get_bypass_state(surface);
+
+	if (!state || state->active == active)
+		return;
+
+	state->active = active;
+	wl_gdl_surface_send_bypass_state(state->resource, active);
+}
+
+void
+wl_gdl_surface_set_visible(struct wl_resource *surface, bool visible)
+{
+	struct bypass_state *state = get_bypass_state(surface);
+
+	if (!state || state->visible == visible)
+		return;
+
+	state->visible = visible;
+
+	if (wl_resource_get_version(state->resource) >=
+	    WL_GDL_SURFACE_VISIBILITY_SINCE_VERSION)
+		wl_gdl_surface_send_visibility(state->resource, visible);
+}
+
 static const struct wl_gdl_interface gdl_interface = {
 	create_buffer,
+	create_buffer2,
+	create_planar_buffer,
+	get_surface,
 };
 
 static void
@@ -68,19 +652,192 @@ bind_gdl(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 {
 	struct wl_resource *resource;
 
-	resource = wl_resource_create(client, &wl_gdl_interface, 1, id);
+	if (version > 6)
+		version = 6;
+
+	resource = wl_resource_create(client, &wl_gdl_interface, version, id);
 	if (!resource) {
 		wl_client_post_no_memory(client);
 		return;
 	}
 
 	wl_resource_set_implementation(resource, &gdl_interface, data, NULL);
+
+	if (version < WL_GDL_FORMAT_SINCE_VERSION)
+		return;
+
+	for (unsigned i = 0; i < FORMAT_COUNT; i++)
+		if (formats[i].flags)
+			wl_gdl_send_format(resource, formats[i].pixel_format,
+					   formats[i].flags);
 }
 
 int
 wl_display_init_gdl(struct wl_display *display)
 {
-	if (!wl_global_create(display, &wl_gdl_interface, 1, NULL, bind_gdl))
+	if (!wl_global_create(display, &wl_gdl_interface, 6, NULL, bind_gdl))
+		return -1;
+
+	return 0;
+}
+
+int
+wl_gdl_set_format_flags(gdl_pixel_format_t pixel_format, uint32_t flags)
+{
+	for (unsigned i = 0; i < FORMAT_COUNT; i++) {
+		if (formats[i].pixel_format == pixel_format) {
+			formats[i].flags = flags;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static void
+destroy_timeline(struct wl_resource *resource)
+{
+	timeline_unref(wl_resource_get_user_data(resource));
+}
+
+static void
+timeline_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static const struct wl_gdl_timeline_interface timeline_interface = {
+	timeline_destroy,
+};
+
+static void
+sync_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+sync_create_timeline(struct wl_client *client, struct wl_resource *resource,
+		     uint32_t id, int32_t fd)
+{
+	struct wl_gdl_timeline *timeline;
+	struct wl_resource *timeline_resource;
+	struct stat st;
+	int seals;
+	void *page;
+
+	/* accessing a page past the end of the file would raise SIGBUS, so
+	 * the client must not be able to shrink it later */
+	seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+		close(fd);
+		wl_resource_post_error(resource,
+				       WL_GDL_EXPLICIT_SYNC_ERROR_INVALID_TIMELINE,
+				       "timeline file not sealed against shrinking");
+		return;
+	}
+
+	if (fstat(fd, &st) < 0 ||
+	    st.st_size < (off_t) sizeof (struct wl_gdl_timeline_page)) {
+		close(fd);
+		wl_resource_post_error(resource,
+				       WL_GDL_EXPLICIT_SYNC_ERROR_INVALID_TIMELINE,
+				       "timeline file too small");
+		return;
+	}
+
+	page = mmap(NULL, sizeof (struct wl_gdl_timeline_page),
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (page == MAP_FAILED) {
+		wl_resource_post_error(resource,
+				       WL_GDL_EXPLICIT_SYNC_ERROR_INVALID_TIMELINE,
+				       "failed to map timeline");
+		return;
+	}
+
+	timeline = malloc(sizeof (*timeline));
+	if (!timeline) {
+		munmap(page, sizeof (struct wl_gdl_timeline_page));
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	timeline->refcount = 1;
+	timeline->page = page;
+
+	timeline_resource = wl_resource_create(client,
+					       &wl_gdl_timeline_interface,
+					       1, id);
+	if (!timeline_resource) {
+		timeline_unref(timeline);
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	wl_resource_set_implementation(timeline_resource,
+				       &timeline_interface,
+				       timeline, destroy_timeline);
+}
+
+static void
+sync_set_buffer_sync(struct wl_client *client, struct wl_resource *resource,
+		     struct wl_resource *buffer_resource,
+		     struct wl_resource *acquire_resource,
+		     uint32_t acquire_point_hi, uint32_t acquire_point_lo,
+		     struct wl_resource *release_resource,
+		     uint32_t release_point_hi, uint32_t release_point_lo)
+{
+	struct wl_gdl_buffer *buffer = wl_gdl_buffer_get(buffer_resource);
+
+	if (!buffer) {
+		wl_resource_post_error(resource,
+				       WL_GDL_EXPLICIT_SYNC_ERROR_INVALID_BUFFER,
+				       "not a wl_gdl buffer");
+		return;
+	}
+
+	buffer_clear_sync(buffer);
+
+	buffer->acquire_timeline =
+		timeline_ref(wl_resource_get_user_data(acquire_resource));
+	buffer->acquire_point =
+		((uint64_t) acquire_point_hi << 32) | acquire_point_lo;
+	buffer->release_timeline =
+		timeline_ref(wl_resource_get_user_data(release_resource));
+	buffer->release_point =
+		((uint64_t) release_point_hi << 32) | release_point_lo;
+}
+
+static const struct wl_gdl_explicit_sync_interface explicit_sync_interface = {
+	sync_destroy,
+	sync_create_timeline,
+	sync_set_buffer_sync,
+};
+
+static void
+bind_explicit_sync(struct wl_client *client, void *data,
+		   uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &wl_gdl_explicit_sync_interface,
+				      1, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(resource, &explicit_sync_interface,
+				       data, NULL);
+}
+
+int
+wl_display_init_gdl_explicit_sync(struct wl_display *display)
+{
+	if (!wl_global_create(display, &wl_gdl_explicit_sync_interface, 1,
+			      NULL, bind_explicit_sync))
 		return -1;
 
 	return 0;
@@ -101,3 +858,360 @@ wl_gdl_buffer_get_surface_info(struct wl_gdl_buffer *buffer)
 {
 	return &buffer->surface_info;
 }
+
+bool
+wl_gdl_buffer_is_ready(struct wl_gdl_buffer *buffer)
+{
+	if (!buffer->acquire_timeline)
+		return true;
+
+	return wl_gdl_timeline_is_signaled(buffer->acquire_timeline->page,
+					   buffer->acquire_point);
+}
+
+int
+wl_gdl_buffer_wait_ready(struct wl_gdl_buffer *buffer, int timeout_ms)
+{
+	if (!buffer->acquire_timeline)
+		return 0;
+
+	/* the client controls the timeline, never wait on it forever */
+	if (timeout_ms < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return wl_gdl_timeline_wait(buffer->acquire_timeline->page,
+				    buffer->acquire_point, timeout_ms);
+}
+
+void
+wl_gdl_buffer_release(struct wl_gdl_buffer *buffer)
+{
+	if (!buffer->release_timeline) {
+		wl_buffer_send_release(buffer->resource);
+		return;
+	}
+
+	wl_gdl_timeline_signal(buffer->release_timeline->page,
+			       buffer->release_point);
+	buffer_clear_sync(buffer);
+}
+
+void *
+wl_gdl_buffer_get_data(struct wl_gdl_buffer *buffer)
+{
+	gdl_ret_t rc;
+
+	if (buffer->data)
+		return buffer->data + buffer->offset;
+
+	rc = gdl_map_surface(buffer->surface_info.id, &buffer->data, NULL);
+	if (rc != GDL_SUCCESS) {
+		buffer->data = NULL;
+		return NULL;
+	}
+
+	return buffer->data + buffer->offset;
+}
+
+static gma_ret_t
+pixmap_destroy(gma_pixmap_info_t *pixmap_info)
+{
+	/* the mapping belongs to the buffer */
+	return GMA_SUCCESS;
+}
+
+static bool
+convert_gdl_pixel_format(gdl_pixel_format_t gdl_pf, gma_pixel_format_t *gma_pf)
+{
+	switch (gdl_pf) {
+	case GDL_PF_ARGB_32:		*gma_pf = GMA_PF_ARGB_32; break;
+	case GDL_PF_RGB_32:		*gma_pf = GMA_PF_RGB_32; break;
+	case GDL_PF_ARGB_16_1555:	*gma_pf = GMA_PF_ARGB_16_1555; break;
+	case GDL_PF_ARGB_16_4444:	*gma_pf = GMA_PF_ARGB_16_4444; break;
+	case GDL_PF_RGB_16:		*gma_pf = GMA_PF_RGB_16; break;
+	case GDL_PF_AY16:		*gma_pf = GMA_PF_AY16; break;
+	case GDL_PF_A8:			*gma_pf = GMA_PF_A8; break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+gma_pixmap_t
+wl_gdl_buffer_get_gma_pixmap(struct wl_gdl_buffer *buffer)
+{
+	gdl_surface_info_t *surface_info = &buffer->surface_info;
+	gma_pixmap_info_t info;
+	gma_pixmap_funcs_t funcs;
+
+	if (buffer->pixmap)
+		return buffer->pixmap;
+
+	if (!convert_gdl_pixel_format(surface_info->pixel_format,
+				      &info.format))
+		return NULL;
+
+	info.virt_addr = wl_gdl_buffer_get_data(buffer);
+	if (!info.virt_addr)
+		return NULL;
+
+	info.type = GMA_PIXMAP_TYPE_PHYSICAL;
+	info.phys_addr = surface_info->phys_addr;
+	info.width = surface_info->width;
+	info.height = surface_info->height;
+	info.pitch = surface_info->pitch;
+	info.user_data = buffer;
+
+	funcs.destroy = pixmap_destroy;
+
+	if (gma_pixmap_alloc(&info, &funcs, &buffer->pixmap) != GMA_SUCCESS) {
+		buffer->pixmap = NULL;
+		return NULL;
+	}
+
+	return buffer->pixmap;
+}
+
+PVR2DMEMINFO *
+wl_gdl_buffer_get_meminfo(struct wl_gdl_buffer *buffer,
+			  PVR2DCONTEXTHANDLE context)
+{
+	gdl_surface_info_t *surface_info = &buffer->surface_info;
+	struct buffer_meminfo *mi;
+	unsigned long page_addr;
+	void *data;
+
+	wl_list_for_each(mi, &buffer->meminfos, link) {
+		if (mi->context == context)
+			return mi->meminfo;
+	}
+
+	data = wl_gdl_buffer_get_data(buffer);
+	if (!data)
+		return NULL;
+
+	mi = malloc(sizeof (*mi));
+	if (!mi)
+		return NULL;
+
+	page_addr = surface_info->phys_addr & ~(getpagesize() - 1);
+
+	if (PVR2DMemWrap(context, data, PVR2D_WRAPFLAG_CONTIGUOUS,
+			 surface_info->size, &page_addr, &mi->meminfo) != PVR2D_OK) {
+		free(mi);
+		return NULL;
+	}
+
+	mi->context = context;
+	wl_list_insert(&buffer->meminfos, &mi->link);
+
+	return mi->meminfo;
+}
+
+static bool
+plane_supports_format(gdl_plane_id_t id, gdl_pixel_format_t pixel_format)
+{
+	switch (pixel_format) {
+	case GDL_PF_ARGB_32:
+	case GDL_PF_RGB_32:
+	case GDL_PF_ARGB_16_1555:
+	case GDL_PF_ARGB_16_4444:
+	case GDL_PF_RGB_16:
+		return true;
+	case GDL_PF_NV12:
+	case GDL_PF_NV16:
+	case GDL_PF_YUY2:
+	case GDL_PF_UYVY:
+	case GDL_PF_YVYU:
+	case GDL_PF_VYUY:
+	case GDL_PF_YV12:
+	case GDL_PF_I420:
+	case GDL_PF_YV16:
+	case GDL_PF_I422:
+		/* only the video planes convert YUV */
+		return id == GDL_PLANE_ID_UPP_A || id == GDL_PLANE_ID_UPP_B;
+	default:
+		return false;
+	}
+}
+
+static bool
+is_yuv_format(gdl_pixel_format_t pixel_format)
+{
+	const struct format_layout *layout = get_format_layout(pixel_format);
+
+	return layout && layout->yuv;
+}
+
+static gdl_color_space_t
+source_color_space(const gdl_surface_info_t *info)
+{
+	if (!is_yuv_format(info->pixel_format))
+		return GDL_COLOR_SPACE_RGB;
+
+	/* SD video uses BT.601, HD BT.709 */
+	return info->height > 576 ? GDL_COLOR_SPACE_BT709 :
+		GDL_COLOR_SPACE_BT601;
+}
+
+static gdl_ret_t
+plane_configure(gdl_plane_id_t id, struct gdl_plane *plane,
+		const gdl_surface_info_t *info, const gdl_rectangle_t *rect)
+{
+	gdl_rectangle_t src_rect, dst_rect;
+	gdl_ret_t rc;
+
+	if (plane->configured &&
+	    plane->pixel_format == info->pixel_format &&
+	    plane->src_width == info->width &&
+	    plane->src_height == info->height &&
+	    plane->rect.origin.x == rect->origin.x &&
+	    plane->rect.origin.y == rect->origin.y &&
+	    plane->rect.width == rect->width &&
+	    plane->rect.height == rect->height)
+		return GDL_SUCCESS;
+
+	src_rect.origin.x = 0;
+	src_rect.origin.y = 0;
+	src_rect.width = info->width;
+	src_rect.height = info->height;
+	dst_rect = *rect;
+
+	rc = gdl_plane_config_begin(id);
+	if (rc != GDL_SUCCESS)
+		return rc;
+
+	rc = gdl_plane_set_uint(GDL_PLANE_PIXEL_FORMAT, info->pixel_format);
+	if (rc == GDL_SUCCESS)
+		rc = gdl_plane_set_uint(GDL_PLANE_SRC_COLOR_SPACE,
+					source_color_space(info));
+	if (rc == GDL_SUCCESS)
+		rc = gdl_plane_set_rect(GDL_PLANE_SRC_RECT, &src_rect);
+	if (rc == GDL_SUCCESS)
+		rc = gdl_plane_set_rect(GDL_PLANE_DST_RECT, &dst_rect);
+
+	if (rc != GDL_SUCCESS) {
+		gdl_plane_config_end(GDL_TRUE);
+		plane->configured = false;
+		return rc;
+	}
+
+	rc = gdl_plane_config_end(GDL_FALSE);
+	plane->configured = rc == GDL_SUCCESS;
+	plane->pixel_format = info->pixel_format;
+	plane->src_width = info->width;
+	plane->src_height = info->height;
+	plane->rect = *rect;
+
+	return rc;
+}
+
+int
+wl_gdl_buffer_flip_to_plane(struct wl_gdl_buffer *buffer,
+			    gdl_plane_id_t id, const gdl_rectangle_t *rect)
+{
+	gdl_surface_info_t *info = &buffer->surface_info;
+	struct gdl_plane *plane;
+	gdl_display_info_t display_info;
+
+	plane = get_plane(id);
+	if (!plane)
+		return -1;
+
+	/* a buffer scans out from one plane at a time */
+	if (buffer->plane != GDL_PLANE_ID_UNDEFINED && buffer->plane != id)
+		return -1;
+
+	if (!plane_supports_format(id, info->pixel_format))
+		return -1;
+
+	/* planes scan out whole surfaces */
+	if (buffer->offset != 0 ||
+	    info->width != buffer->surface->info.width ||
+	    info->height != buffer->surface->info.height ||
+	    info->pitch != buffer->surface->info.pitch ||
+	    info->pixel_format != buffer->surface->info.pixel_format ||
+	    info->uv_pitch != buffer->surface->info.uv_pitch ||
+	    info->u_offset != buffer->surface->info.u_offset ||
+	    info->v_offset != buffer->surface->info.v_offset)
+		return -1;
+
+	/* planes do not scale RGB surfaces */
+	if (!is_yuv_format(info->pixel_format) &&
+	    (rect->width != info->width || rect->height != info->height))
+		return -1;
+
+	if (gdl_get_display_info(GDL_DISPLAY_ID_0,
+				 &display_info) != GDL_SUCCESS)
+		return -1;
+
+	if (rect->origin.x < 0 || rect->origin.y < 0 ||
+	    rect->origin.x + rect->width > display_info.tvmode.width ||
+	    rect->origin.y + rect->height > display_info.tvmode.height)
+		return -1;
+
+	if (plane_configure(id, plane, info, rect) != GDL_SUCCESS)
+		return -1;
+
+	if (gdl_flip(id, info->id, GDL_FLIP_ASYNC) != GDL_SUCCESS)
+		return -1;
+
+	if (plane->front == buffer)
+		return 0;
+
+	if (buffer->retired) {
+		wl_list_remove(&buffer->plane_link);
+		buffer->retired = false;
+	}
+
+	plane_retire_front(plane);
+	plane->front = buffer;
+	buffer->plane = id;
+
+	return 0;
+}
+
+void
+wl_gdl_plane_vblank(gdl_plane_id_t id)
+{
+	struct gdl_plane *plane = get_plane(id);
+	struct wl_gdl_buffer *buffer, *tmp;
+
+	if (!plane)
+		return;
+
+	wl_list_for_each_safe(buffer, tmp, &plane->retired, plane_link) {
+		wl_list_remove(&buffer->plane_link);
+		buffer->retired = false;
+		buffer->plane = GDL_PLANE_ID_UNDEFINED;
+		wl_gdl_buffer_release(buffer);
+	}
+}
+
+int
+wl_gdl_plane_clear(gdl_plane_id_t id)
+{
+	struct gdl_plane *plane = get_plane(id);
+
+	if (!plane)
+		return -1;
+
+	if (gdl_flip(id, GDL_SURFACE_INVALID, GDL_FLIP_ASYNC) != GDL_SUCCESS)
+		return -1;
+
+	plane_retire_front(plane);
+	plane->configured = false;
+
+	return 0;
+}
+
+struct wl_gdl_buffer *
+wl_gdl_plane_get_buffer(gdl_plane_id_t id)
+{
+	struct gdl_plane *plane = get_plane(id);
+
+	return plane ? plane->front : NULL;
+}
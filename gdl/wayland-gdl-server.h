@@ -2,16 +2,92 @@
 # define WAYLAND_GDL_H_
 
 #include <gdl_types.h>
+#include <libgma.h>
+#include <pvr2d.h>
 #include <wayland-server.h>
 #include "wayland-gdl-server-protocol.h"
+#include "wayland-gdl-timeline.h"
 
 struct wl_gdl_buffer;
 
 int wl_display_init_gdl(struct wl_display *display);
 
+/* The bypass hint a client set on a wl_surface with wl_gdl_surface, and
+ * the way to report whether the compositor follows it; the event is only
+ * sent when the state changes. */
+bool wl_gdl_surface_bypass_preferred(struct wl_resource *surface);
+
+void wl_gdl_surface_set_bypass_active(struct wl_resource *surface,
+				      bool active);
+
+/* report to the client whether the surface can be seen; only sent on
+ * changes, to clients that bound wl_gdl version 6 or later */
+void wl_gdl_surface_set_visible(struct wl_resource *surface, bool visible);
+
+/* Change the flags advertised for a format, a combination of
+ * enum wl_gdl_format_flags; 0 stops advertising it. Only affects clients
+ * binding wl_gdl afterwards. Returns -1 for unknown formats. */
+int wl_gdl_set_format_flags(gdl_pixel_format_t format, uint32_t flags);
+
+/* Advertise wl_gdl_explicit_sync. The compositor must then check
+ * wl_gdl_buffer_is_ready, or wait with wl_gdl_buffer_wait_ready, before
+ * reading an attached buffer, and give buffers back with
+ * wl_gdl_buffer_release instead of wl_buffer_send_release. */
+int wl_display_init_gdl_explicit_sync(struct wl_display *display);
+
 struct wl_gdl_buffer *wl_gdl_buffer_get(struct wl_resource *resource);
 
 gdl_surface_info_t *
 wl_gdl_buffer_get_surface_info(struct wl_gdl_buffer *buffer);
 
+/* whether the rendering to the buffer has completed */
+bool wl_gdl_buffer_is_ready(struct wl_gdl_buffer *buffer);
+
+/* returns 0 once ready, -1 on timeout. The timeout must not be negative:
+ * a client may never signal its point, so a compositor should use a few
+ * frames at most and treat a timeout like a buffer that is not ready. */
+int wl_gdl_buffer_wait_ready(struct wl_gdl_buffer *buffer, int timeout_ms);
+
+/* signal the release point of the buffer, or send wl_buffer.release
+ * when the client did not set one */
+void wl_gdl_buffer_release(struct wl_gdl_buffer *buffer);
+
+/* The following accessors create the mapping, pixmap or PVR2D wrapping of
+ * the buffer surface on first use and keep it for the lifetime of the
+ * wl_buffer resource; the caller must not release what they return.
+ * They return NULL on failure. */
+void *wl_gdl_buffer_get_data(struct wl_gdl_buffer *buffer);
+
+gma_pixmap_t wl_gdl_buffer_get_gma_pixmap(struct wl_gdl_buffer *buffer);
+
+/* the buffer is wrapped once per context, each wrap lives as long as the
+ * buffer */
+PVR2DMEMINFO *
+wl_gdl_buffer_get_meminfo(struct wl_gdl_buffer *buffer,
+			  PVR2DCONTEXTHANDLE context);
+
+/* Scan a buffer out directly from a universal pixel plane, at rect on
+ * the display. RGB buffers can go on any plane, and rect must have their
+ * size since planes do not scale RGB content. YUV buffers can only go on
+ * the video planes (UPP_A and UPP_B), which convert and scale them to
+ * rect. Returns -1 if the buffer cannot be shown on this plane.
+ *
+ * The buffer the plane was showing before is released on the next call
+ * to wl_gdl_plane_vblank, which the compositor makes once the vblank
+ * following the flip has passed. Buffers flipped to a plane are released
+ * by this library and must not be released by the compositor. When the
+ * client destroys the buffer a plane shows, the plane is disabled; when
+ * it destroys one awaiting release, the next vblank is waited for. */
+int
+wl_gdl_buffer_flip_to_plane(struct wl_gdl_buffer *buffer,
+			    gdl_plane_id_t plane, const gdl_rectangle_t *rect);
+
+void wl_gdl_plane_vblank(gdl_plane_id_t plane);
+
+/* Stop scanning out from the plane, its buffer is released at the next
+ * vblank. */
+int wl_gdl_plane_clear(gdl_plane_id_t plane);
+
+struct wl_gdl_buffer *wl_gdl_plane_get_buffer(gdl_plane_id_t plane);
+
 #endif /* !WAYLAND_GDL_H_ */
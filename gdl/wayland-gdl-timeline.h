@@ -0,0 +1,82 @@
+#ifndef WAYLAND_GDL_TIMELINE_H_
+# define WAYLAND_GDL_TIMELINE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* Shared memory behind a wl_gdl_timeline. Its value only increases, a
+ * point is signaled once the value reaches it. The single signaler
+ * stores the value then bumps seq, the futex word waiters sleep on. */
+struct wl_gdl_timeline_page {
+	uint32_t seq;
+	uint32_t padding;
+	uint64_t value;
+};
+
+static inline bool
+wl_gdl_timeline_is_signaled(struct wl_gdl_timeline_page *page, uint64_t point)
+{
+	return __atomic_load_n(&page->value, __ATOMIC_ACQUIRE) >= point;
+}
+
+static inline void
+wl_gdl_timeline_signal(struct wl_gdl_timeline_page *page, uint64_t point)
+{
+	if (wl_gdl_timeline_is_signaled(page, point))
+		return;
+
+	__atomic_store_n(&page->value, point, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&page->seq, 1, __ATOMIC_RELEASE);
+
+	/* waiters may live in another process */
+	syscall(SYS_futex, &page->seq, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+/* Wait until the point is signaled, or for timeout_ms if not negative.
+ * Returns 0 once signaled, or -1 with errno set to ETIMEDOUT. */
+static inline int
+wl_gdl_timeline_wait(struct wl_gdl_timeline_page *page, uint64_t point,
+		     int timeout_ms)
+{
+	struct timespec now, end, ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += timeout_ms / 1000;
+	end.tv_nsec += (timeout_ms % 1000) * 1000000;
+	if (end.tv_nsec >= 1000000000) {
+		end.tv_sec++;
+		end.tv_nsec -= 1000000000;
+	}
+
+	for (;;) {
+		uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+
+		if (wl_gdl_timeline_is_signaled(page, point))
+			return 0;
+
+		if (timeout_ms >= 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			ts.tv_sec = end.tv_sec - now.tv_sec;
+			ts.tv_nsec = end.tv_nsec - now.tv_nsec;
+			if (ts.tv_nsec < 0) {
+				ts.tv_sec--;
+				ts.tv_nsec += 1000000000;
+			}
+
+			if (ts.tv_sec < 0) {
+				errno = ETIMEDOUT;
+				return -1;
+			}
+		}
+
+		syscall(SYS_futex, &page->seq, FUTEX_WAIT, seq,
+			timeout_ms >= 0 ? &ts : NULL, NULL, 0);
+	}
+}
+
+#endif /* !WAYLAND_GDL_TIMELINE_H_ */
@@ -2,5 +2,6 @@
 # define WAYLAND_GDL_H
 
 #include <wayland-gdl-client-protocol.h>
+#include <wayland-gdl-timeline.h>
 
 #endif /* !WAYLAND_GDL_H */